@@ -0,0 +1,112 @@
+// ---------------------------------------------------------------------
+// BatchRunner.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "BatchRunner.hpp"
+#include <algorithm>
+
+// ---------------------------------------------------------------------
+// BatchRunner Implementation
+// ---------------------------------------------------------------------
+BatchRunner::BatchRunner(InferenceQueue& queue, ResponseCache* cache, size_t max_in_flight)
+    : m_queue(queue), m_cache(cache), m_max_in_flight(std::max<size_t>(1, max_in_flight))
+{
+}
+
+BatchRunner::~BatchRunner()
+{
+    cancel();
+    std::unique_lock<std::mutex> lk(m_shared->mu);
+    m_shared->cv.wait(lk, [this] { return m_shared->done.size() >= m_in_flight; });
+}
+
+bool BatchRunner::try_start(BatchItem& item) {
+    using clock = std::chrono::steady_clock;
+
+    if (m_cache && item.cache_key) {
+        if (auto hit = m_cache->lookup(*item.cache_key)) {
+            BatchOutcome outcome;
+            outcome.index = item.index;
+            outcome.output = hit->text();
+            outcome.result = hit->result();
+            outcome.cached = true;
+            {
+                std::lock_guard<std::mutex> lk(m_shared->mu);
+                m_shared->done.push_back(std::move(outcome));
+            }
+            ++m_in_flight; // handed back by next() like any other item
+            return true;
+        }
+    }
+
+    if (m_in_flight >= m_max_in_flight) return false;
+    auto slot = m_reserved ? std::move(m_reserved) : m_queue.try_admit();
+    m_reserved.reset();
+    if (!slot) return false;
+
+    // Per-item state lives with the job; the worker fills it in.
+    struct Running {
+        BatchOutcome outcome;
+        clock::time_point start = clock::now();
+        bool first = true;
+        ResponseCache::Recorder recorder;
+    };
+    auto running = std::make_shared<Running>();
+    running->outcome.index = item.index;
+
+    InferenceJob job;
+    job.sys_prompt = std::move(item.sys_prompt);
+    job.user_prompt = std::move(item.user_prompt);
+    job.params = std::move(item.params);
+    job.cancel = &m_shared->cancel;
+    const bool record = m_cache && item.cache_key;
+    job.callback = [running, record](const char* text, SentenceCode) {
+        if (running->first && *text) {
+            running->first = false;
+            running->outcome.ttft_s =
+                std::chrono::duration<double>(clock::now() - running->start).count();
+        }
+        running->outcome.output += text;
+        if (record) running->recorder.record(text);
+    };
+    job.on_complete = [running, shared = m_shared, cache = m_cache, key = item.cache_key]
+                      (const GenerationResult& result, std::exception_ptr error) {
+        BatchOutcome& outcome = running->outcome;
+        outcome.result = result;
+        outcome.latency_s = std::chrono::duration<double>(clock::now() - running->start).count();
+        if (error) {
+            try {
+                std::rethrow_exception(error);
+            } catch (const std::exception& e) {
+                outcome.error = e.what();
+            } catch (...) {
+                outcome.error = "unknown error";
+            }
+        } else if (cache && key && result.finish_reason != FinishReason::Aborted) {
+            cache->insert(*key, running->recorder.finish(result));
+        }
+        {
+            std::lock_guard<std::mutex> lk(shared->mu);
+            shared->done.push_back(std::move(outcome));
+        }
+        shared->cv.notify_all();
+    };
+
+    // Nobody waits on the PendingJob; on_complete reports the outcome.
+    m_queue.submit(std::move(*slot), std::move(job));
+    ++m_in_flight;
+    return true;
+}
+
+std::optional<BatchOutcome> BatchRunner::next(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lk(m_shared->mu);
+    if (!m_shared->cv.wait_for(lk, timeout, [this] { return !m_shared->done.empty(); })) {
+        return std::nullopt;
+    }
+    BatchOutcome outcome = std::move(m_shared->done.front());
+    m_shared->done.pop_front();
+    --m_in_flight;
+    return outcome;
+}
@@ -0,0 +1,84 @@
+// ---------------------------------------------------------------------
+// BatchRunner.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include "InferenceQueue.hpp"
+#include "ResponseCache.hpp"
+
+/// One request of a batch.
+struct BatchItem {
+    size_t index = 0;
+    std::string sys_prompt;
+    std::string user_prompt;
+    GenerationParams params;
+    std::optional<RequestKey> cache_key;   ///< Set to use the response cache
+};
+
+/// How a batch item ended.
+struct BatchOutcome {
+    size_t index = 0;
+    std::string output;
+    GenerationResult result;
+    std::string error;                     ///< Non-empty if the query failed
+    double latency_s = 0.0;                ///< Start of the item to its completion
+    double ttft_s = 0.0;                   ///< Start of the item to its first token
+    bool cached = false;
+};
+
+// ---------------------------------------------------------------------
+// BatchRunner: drives many requests through the queue, a few at a time
+// ---------------------------------------------------------------------
+/// Keeps at most `max_in_flight` items in the InferenceQueue so a batch
+/// cannot crowd out interactive traffic, and hands back completions in
+/// the order they finish. All methods are for a single driving thread.
+class BatchRunner {
+public:
+    BatchRunner(InferenceQueue& queue, ResponseCache* cache, size_t max_in_flight);
+
+    /// Aborts whatever is still running and waits for it.
+    ~BatchRunner();
+
+    /// Start `item` (moved from on success). False if max_in_flight items
+    /// are running or the queue is full; retry after next().
+    bool try_start(BatchItem& item);
+
+    /// Start the next item that needs the queue in `slot`, reserved by the
+    /// caller, instead of admitting it anew.
+    void adopt(InferenceQueue::Slot slot) { m_reserved.emplace(std::move(slot)); }
+
+    /// Next finished item, waiting up to `timeout`.
+    std::optional<BatchOutcome> next(std::chrono::milliseconds timeout);
+
+    size_t in_flight() const { return m_in_flight; }
+
+    /// Abort every running item; they still complete through next().
+    void cancel() { m_shared->cancel.store(true, std::memory_order_relaxed); }
+
+private:
+    /// Outlives the runner if a worker is still finishing an item.
+    struct Shared {
+        std::atomic<bool> cancel{false};
+        std::mutex mu;
+        std::condition_variable cv;
+        std::deque<BatchOutcome> done;
+    };
+
+    InferenceQueue& m_queue;
+    ResponseCache* m_cache;
+    const size_t m_max_in_flight;
+    size_t m_in_flight = 0;
+    std::optional<InferenceQueue::Slot> m_reserved;
+    std::shared_ptr<Shared> m_shared = std::make_shared<Shared>();
+};
@@ -0,0 +1,338 @@
+// ---------------------------------------------------------------------
+// Bench.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+// chat_bench: microbenchmarks of the CPU work around inference on the
+// request path, reported as ns/op and heap allocations/op.
+
+#include "httplib.h"
+#include "ChatManager.hpp"
+#include "CliArgs.hpp"
+#include "PromptHandler.hpp"
+#include "StreamEncoder.hpp"
+#include <json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+// ---------------------------------------------------------------------
+// Allocation counting: every operator new in the process goes through here
+// ---------------------------------------------------------------------
+namespace {
+    std::atomic<uint64_t> g_allocations{0};
+    std::atomic<uint64_t> g_allocated_bytes{0};
+
+    void* CountedAlloc(std::size_t size) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+        if (void* p = std::malloc(size ? size : 1)) return p;
+        throw std::bad_alloc();
+    }
+} // namespace
+
+void* operator new(std::size_t size) { return CountedAlloc(size); }
+void* operator new[](std::size_t size) { return CountedAlloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr const std::string_view c_option_filter   = "--filter";
+constexpr const std::string_view c_option_min_time = "--min-time-ms";
+constexpr const std::string_view c_option_json     = "--json";
+constexpr const std::string_view c_option_help     = "--help";
+constexpr const std::string_view c_option_help_short = "-h";
+
+/// Tokens per simulated generation; the MyStoryPal correction call is ~120.
+constexpr size_t c_tokens_per_generation = 120;
+
+/// Keep `value` observable so the optimizer cannot drop the work producing it.
+template <typename T>
+void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations = 0;
+    double ns_per_op = 0.0;
+    double allocs_per_op = 0.0;
+    double bytes_per_op = 0.0;
+};
+
+/// Run `op` in growing batches until one batch takes `min_time`, and
+/// report that batch. Allocation counts come from the same batch.
+template <typename Op>
+BenchResult Measure(const std::string& name, std::chrono::milliseconds min_time, Op&& op) {
+    op(); // warm caches and lazily built state
+    for (uint64_t iterations = 1;; iterations *= 2) {
+        const uint64_t allocs_before = g_allocations.load(std::memory_order_relaxed);
+        const uint64_t bytes_before = g_allocated_bytes.load(std::memory_order_relaxed);
+        const Clock::time_point start = Clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) op();
+        const Clock::duration elapsed = Clock::now() - start;
+        if (elapsed < min_time && iterations < (uint64_t{1} << 40)) continue;
+
+        const double n = static_cast<double>(iterations);
+        BenchResult result;
+        result.name = name;
+        result.iterations = iterations;
+        result.ns_per_op = static_cast<double>(
+                               std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / n;
+        result.allocs_per_op =
+            static_cast<double>(g_allocations.load(std::memory_order_relaxed) - allocs_before) / n;
+        result.bytes_per_op =
+            static_cast<double>(g_allocated_bytes.load(std::memory_order_relaxed) - bytes_before) / n;
+        return result;
+    }
+}
+
+// ---------------------------------------------------------------------
+// Fixtures
+// ---------------------------------------------------------------------
+const std::string c_classifier_body = R"({"sys_prompt":"You are an assistant in a children's story-builder app. For each user message, decide if it is part of the STORY or just a QUESTION/CHAT. If it is a story sentence, correct grammar/spelling only as needed but keep the child's voice. Respond with EXACTLY ONE JSON object in the format: {\"is_story\": true} or {\"is_story\": false}.","user_prompt":"the dragon flyed over the mountin and saw a castel","max_new_tokens":8,"temperature":0,"response_format":"json_object"})";
+
+const std::string c_correction_body = R"({"sys_prompt":"You are an assistant in a children's story-builder app. When a child writes a sentence, correct grammar and spelling only when needed, while keeping their original voice and creativity intact. After correcting, give a clear and encouraging explanation of why the change was made. The explanation should be more than one short phrase — use a complete sentence or two that helps the child learn while also feeling positive and supported.\nOutput your response as a single JSON object in the format:\n{\"corrected_sentence\": \"sentence\", \"explanation\": \"reason\"}","user_prompt":"The princess runned to the forest to find her dog","max_new_tokens":120,"stop":["\n\n"],"response_format":{"type":"json_object"}})";
+
+/// Token texts shaped like a JSON correction reply.
+std::vector<std::string> MakeTokens(size_t count) {
+    static const char* const c_pieces[] = {"{\"", "corrected", "_sentence", "\":", " \"", "The", " princess",
+                                           " ran", " to", " the", " forest", ".\"", ",", " \"", "explanation",
+                                           "\":", " \"", "Great", " job", "!", " We", " say", " ran"};
+    std::vector<std::string> tokens;
+    for (size_t i = 0; i < count; ++i) {
+        tokens.emplace_back(c_pieces[i % (sizeof(c_pieces) / sizeof(c_pieces[0]))]);
+    }
+    return tokens;
+}
+
+/// Emits a fixed token sequence without sleeping, so ChatManager::query
+/// costs only its own bookkeeping and callback dispatch.
+class ReplayDialog : public InferenceDialog {
+public:
+    explicit ReplayDialog(const std::vector<std::string>& tokens) : m_tokens(tokens) {}
+
+    bool query(const std::string&, const TokenCallback& callback) override {
+        for (size_t i = 0; i < m_tokens.size(); ++i) {
+            callback(m_tokens[i].c_str(), i == 0 ? SentenceCode::Begin : SentenceCode::Continue);
+        }
+        callback("", SentenceCode::End);
+        return true;
+    }
+    bool prefill(const std::string&) override { return true; }
+    std::shared_ptr<const DialogState> save_state() override { return nullptr; }
+    bool restore_state(const DialogState&) override { return false; }
+    bool set_sampling(const GenerationParams&) override { return true; }
+    bool reset() override { return true; }
+    bool abort() override { return true; }
+
+private:
+    const std::vector<std::string>& m_tokens;
+};
+
+class ReplayBackend : public InferenceBackend {
+public:
+    explicit ReplayBackend(const std::vector<std::string>& tokens) : m_tokens(tokens) {}
+    std::unique_ptr<InferenceDialog> create_dialog() override { return std::make_unique<ReplayDialog>(m_tokens); }
+    const char* name() const override { return "replay"; }
+
+private:
+    const std::vector<std::string>& m_tokens;
+};
+
+const char* ModelName(llm::prompt::ModelType model) {
+    switch (model) {
+        case llm::prompt::ModelType::Llama3:       return "llama3";
+        case llm::prompt::ModelType::Llama3_Taide: return "llama3_taide";
+        case llm::prompt::ModelType::Llama2:       return "llama2";
+    }
+    return "unknown";
+}
+
+void PrintHelp(const char* exe) {
+    std::cout << "\nUsage:\n"
+              << exe << " [--filter <substring>] [--min-time-ms <ms>] [--json]\n\n"
+              << c_option_filter << " <substring>: Only run benchmarks whose name contains it\n"
+              << c_option_min_time << " <ms>: Shortest measured batch per benchmark (default: 200)\n"
+              << c_option_json << ": Print results as a JSON array instead of a table\n\n"
+              << "Generations are " << c_tokens_per_generation << " tokens; "
+              << "divide their ns/op by that for a per-token cost.\n";
+}
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    std::chrono::milliseconds min_time{200};
+    bool as_json = false;
+    for (int i = 1; i < argc; ++i) {
+        if (c_option_filter == argv[i] && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (c_option_min_time == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_min_time, argv[++i], min_time)) return 1;
+        } else if (c_option_json == argv[i]) {
+            as_json = true;
+        } else if (c_option_help == argv[i] || c_option_help_short == argv[i]) {
+            PrintHelp(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << "\n";
+            PrintHelp(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    auto run = [&](const std::string& name, auto&& op) {
+        if (!filter.empty() && name.find(filter) == std::string::npos) return;
+        results.push_back(Measure(name, min_time, op));
+        if (!as_json) {
+            const BenchResult& r = results.back();
+            std::printf("%-52s %14.1f ns/op %10.2f allocs/op %12.1f B/op\n",
+                        r.name.c_str(), r.ns_per_op, r.allocs_per_op, r.bytes_per_op);
+            std::fflush(stdout);
+        }
+    };
+
+    const std::vector<std::string> tokens = MakeTokens(c_tokens_per_generation);
+
+    // Request bodies
+    run("json_parse/classifier_body", [&] { DoNotOptimize(json::parse(c_classifier_body)); });
+    run("json_parse/correction_body", [&] { DoNotOptimize(json::parse(c_correction_body)); });
+    run("json_parse/correction_body_fields", [&] {
+        const json body = json::parse(c_correction_body);
+        std::string sys_prompt = body.value("sys_prompt", "");
+        std::string user_prompt = body.value("user_prompt", "");
+        DoNotOptimize(sys_prompt);
+        DoNotOptimize(user_prompt);
+    });
+
+    // Prompt tagging
+    const json correction = json::parse(c_correction_body);
+    const std::string sys_prompt = correction["sys_prompt"].get<std::string>();
+    const std::string user_prompt = correction["user_prompt"].get<std::string>();
+    for (const auto model : {llm::prompt::ModelType::Llama3, llm::prompt::ModelType::Llama3_Taide,
+                             llm::prompt::ModelType::Llama2}) {
+        run(std::string("prompt/get_prompt_with_tag/") + ModelName(model), [&] {
+            llm::prompt::PromptUtils utils(model);
+            DoNotOptimize(utils.get_prompt_with_tag(sys_prompt, user_prompt));
+        });
+        run(std::string("prompt/get_subseq_prompt_with_tag/") + ModelName(model), [&] {
+            llm::prompt::PromptUtils utils(model);
+            DoNotOptimize(utils.get_subseq_prompt_with_tag(user_prompt));
+        });
+    }
+
+    // Callback dispatch: a bare std::function call per token, then the
+    // full ChatManager::query path (dialog lock, tagging, run_query's
+    // per-token lambda and the user callback) with and without stop/JSON handling
+    {
+        size_t bytes = 0;
+        const std::function<void(const char*, SentenceCode)> callback = [&](const char* text, SentenceCode) {
+            bytes += std::strlen(text);
+        };
+        run("dispatch/std_function_generation", [&] {
+            for (const std::string& token : tokens) callback(token.c_str(), SentenceCode::Continue);
+            DoNotOptimize(bytes);
+        });
+
+        ChatManager manager(std::make_unique<ReplayBackend>(tokens));
+        manager.create_dialogue_pool(1);
+        const auto dialog = manager.acquire_pooled_dialogue();
+        run("dispatch/chat_manager_query_generation", [&] {
+            DoNotOptimize(manager.query(dialog.id(), sys_prompt, user_prompt, callback));
+        });
+        GenerationParams params;
+        params.stop = {"\n\n"};
+        params.stop_at_json_end = true;
+        run("dispatch/chat_manager_query_generation_stop_json", [&] {
+            DoNotOptimize(manager.query(dialog.id(), sys_prompt, user_prompt, callback, params));
+        });
+    }
+
+    // Streaming: per-token strlen, encoding and flush decisions, written to a sink
+    {
+        StreamFlushPolicy every_token;
+        every_token.interval = std::chrono::milliseconds(0);
+        std::string sink;
+        sink.reserve(64 << 10);
+        auto stream = [&](StreamEncoder& encoder, const StreamFlushPolicy& policy) {
+            FrameBuffer frame(policy);
+            sink.clear();
+            for (size_t i = 0; i < tokens.size(); ++i) {
+                const char* text = tokens[i].c_str();
+                const SentenceCode code = i == 0 ? SentenceCode::Begin : SentenceCode::Continue;
+                encoder.encode_chunk(frame.data(), text, std::strlen(text), code);
+                if (frame.due(code)) {
+                    sink += frame.data();
+                    frame.clear();
+                }
+            }
+            encoder.encode_finish(frame.data(), GenerationResult{});
+            sink += frame.data();
+            DoNotOptimize(sink);
+        };
+        run("stream/plain_text_generation_coalesced", [&] {
+            PlainTextEncoder encoder;
+            stream(encoder, StreamFlushPolicy{});
+        });
+        run("stream/plain_text_generation_every_token", [&] {
+            PlainTextEncoder encoder;
+            stream(encoder, every_token);
+        });
+        run("stream/event_stream_generation_every_token", [&] {
+            EventStreamEncoder encoder(Clock::now());
+            stream(encoder, every_token);
+        });
+        run("stream/field_extract_generation_every_token", [&] {
+            FieldExtractEncoder encoder({"corrected_sentence", "explanation"});
+            stream(encoder, every_token);
+        });
+    }
+
+    // /chat response assembly: accumulate the output, then headers and body
+    run("response/chat_assembly", [&] {
+        std::string output;
+        for (const std::string& token : tokens) output += token.c_str();
+        GenerationResult result;
+        result.generated_tokens = tokens.size();
+        httplib::Response res;
+        res.set_header("X-Request-Id", "1f");
+        res.set_header("X-Finish-Reason", to_string(result.finish_reason));
+        res.set_header("X-Generated-Tokens", std::to_string(result.generated_tokens));
+        res.set_header("X-Tokens-Saved", std::to_string(result.tokens_saved));
+        res.set_header("X-Prompt-Tokens", std::to_string(result.prompt_tokens));
+        res.set_header("X-Prefill-Us", std::to_string(result.prefill_us));
+        res.set_header("X-Decode-Us", std::to_string(result.decode_us));
+        res.set_content(output, "text/plain");
+        DoNotOptimize(res);
+    });
+
+    if (as_json) {
+        json out = json::array();
+        for (const BenchResult& r : results) {
+            out.push_back({{"name", r.name}, {"iterations", r.iterations}, {"ns_per_op", r.ns_per_op},
+                           {"allocs_per_op", r.allocs_per_op}, {"bytes_per_op", r.bytes_per_op}});
+        }
+        std::cout << out.dump(2) << "\n";
+    }
+    return 0;
+}
@@ -5,131 +5,225 @@
 // ---------------------------------------------------------------------
 
 #include "ChatManager.hpp"
+#include "JsonStream.hpp"
+#include "Metrics.hpp"
+#include "StopSequenceMatcher.hpp"
+#include "Trace.hpp"
+#include <chrono>
 #include <stdexcept>
 #include <iostream>
 
-// ---------------------------------------------------------------------
-// Helper types (file-private)
-// ---------------------------------------------------------------------
 namespace {
-    struct CallbackWrapper {
-        ChatManager::GenieResponseCallback fn;
-    };
+    using Clock = std::chrono::steady_clock;
 
-    void trampoline(const char* response_back,
-                    GenieDialog_SentenceCode_t sentence_code,
-                    const void* user_data) {
-        auto* wrapper = static_cast<const CallbackWrapper*>(user_data);
-        if (wrapper && wrapper->fn) {
-            wrapper->fn(response_back, sentence_code);
-        }
+    constexpr size_t c_bytes_per_token = 4; // rough BPE average, as in InferenceQueue
+
+    uint64_t MicrosBetween(Clock::time_point from, Clock::time_point to) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count());
     }
+
+    double SecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    /// Holds a dialogue's lock for a query, recording how long it took to
+    /// get and how long it was held when `metrics` is set.
+    class TimedLock {
+    public:
+        TimedLock(std::mutex& mu, ServerMetrics* metrics)
+            : m_metrics(metrics)
+        {
+            CHATAPP_TRACE_SPAN("dialog_lock_wait");
+            const Clock::time_point requested = m_metrics ? Clock::now() : Clock::time_point{};
+            m_lock = std::unique_lock<std::mutex>(mu);
+            if (m_metrics) {
+                m_acquired = Clock::now();
+                m_metrics->dialog_lock_wait_seconds.observe(
+                    std::chrono::duration<double>(m_acquired - requested).count());
+            }
+        }
+        TimedLock(const TimedLock&) = delete;
+        TimedLock& operator=(const TimedLock&) = delete;
+        ~TimedLock() {
+            m_lock.unlock();
+            if (m_metrics) m_metrics->dialog_lock_hold_seconds.observe(SecondsSince(m_acquired));
+        }
+
+    private:
+        ServerMetrics* m_metrics;
+        std::unique_lock<std::mutex> m_lock;
+        Clock::time_point m_acquired;
+    };
 } // namespace
 
+const char* to_string(FinishReason reason) {
+    switch (reason) {
+        case FinishReason::EndOfTurn:    return "end_of_turn";
+        case FinishReason::MaxTokens:    return "max_tokens";
+        case FinishReason::StopSequence: return "stop_sequence";
+        case FinishReason::JsonComplete: return "json_complete";
+        case FinishReason::Aborted:      return "aborted";
+    }
+    return "unknown";
+}
+
 // ---------------------------------------------------------------------
 // GenieChat Implementation
 // ---------------------------------------------------------------------
-GenieChat::GenieChat(GenieDialogConfig_Handle_t config_handle, bool stateful)
-    : is_stateful(stateful)
+GenieChat::GenieChat(InferenceBackend& backend, bool stateful)
+    : m_dialog(backend.create_dialog()), is_stateful(stateful)
 {
-    if (GENIE_STATUS_SUCCESS !=
-        GenieDialog_create(config_handle, &m_dialog_handle))
-    {
-        throw std::runtime_error("Failed to create Genie Dialog.");
-    }
-}
-
-GenieChat::~GenieChat()
-{
-    if (m_dialog_handle != nullptr)
-    {
-        if (GENIE_STATUS_SUCCESS != GenieDialog_free(m_dialog_handle)) {
-            std::cerr << "Warning: failed to free GenieDialog\n";
-        }
-        m_dialog_handle = nullptr;
-    }
 }
 
 // ---------------------------------------------------------------------
 // ChatManager Implementation
 // ---------------------------------------------------------------------
-ChatManager::ChatManager(const std::string& config_json)
+ChatManager::ChatManager(std::unique_ptr<InferenceBackend> backend)
+    : m_backend(std::move(backend))
 {
-    if (GENIE_STATUS_SUCCESS !=
-        GenieDialogConfig_createFromJson(config_json.c_str(), &m_config_handle))
-    {
-        throw std::runtime_error("Failed to create Genie Dialog config.");
+    if (!m_backend) {
+        throw std::runtime_error("ChatManager requires an inference backend.");
     }
 }
 
 ChatManager::~ChatManager()
 {
-    m_sessions.clear();
-
-    if (m_config_handle != nullptr)
-    {
-        if (GENIE_STATUS_SUCCESS != GenieDialogConfig_free(m_config_handle)) {
-            std::cerr << "Warning: failed to free GenieDialogConfig\n";
-        }
-        m_config_handle = nullptr;
+    // Dialogs and snapshots must be freed before the backend that created them.
+    for (auto& shard : m_shards) {
+        shard.sessions.clear();
     }
+    m_prefix_cache.reset();
 }
 
 std::string ChatManager::create_new_dialogue(bool is_stateful) {
-    static int counter = 0;
-    std::string dialogue_id = "dlg_" + std::to_string(++counter);
+    std::string dialogue_id = "dlg_" + std::to_string(++m_next_id);
 
-    auto chat = std::make_shared<GenieChat>(m_config_handle, is_stateful);
-    m_sessions[dialogue_id] = chat;
+    auto chat = std::make_shared<GenieChat>(*m_backend, is_stateful);
+    auto& shard = shard_for(dialogue_id);
+    std::lock_guard<std::mutex> lk(shard.mu);
+    shard.sessions[dialogue_id] = std::move(chat);
 
     return dialogue_id;
 }
 
 void ChatManager::remove_dialogue(const std::string& dialogue_id) {
-    m_sessions.erase(dialogue_id);
+    std::shared_ptr<GenieChat> chat;
+    {
+        auto& shard = shard_for(dialogue_id);
+        std::lock_guard<std::mutex> lk(shard.mu);
+        auto it = shard.sessions.find(dialogue_id);
+        if (it == shard.sessions.end()) return;
+        chat = std::move(it->second);
+        shard.sessions.erase(it);
+    }
+    // Last reference may free the dialog; do it outside the shard lock.
 }
 
-void ChatManager::query(const std::string& dialogue_id,
-                        const std::string& sys_prompt,
-                        const std::string& user_prompt,
-                        GenieResponseCallback callback)
-{
-    auto chat = get_dialogue(dialogue_id);
+void ChatManager::create_dialogue_pool(size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        std::string dialogue_id = create_new_dialogue(false);
+        std::lock_guard<std::mutex> lk(m_pool_mu);
+        m_pool_free.push_back(std::move(dialogue_id));
+        ++m_pool_size;
+    }
+    m_pool_cv.notify_all();
+}
 
-    llm::prompt::PromptUtils prompt_utils(llm::prompt::ModelType::Llama3);
+void ChatManager::enable_prefix_cache(size_t budget_bytes) {
+    m_prefix_cache = std::make_unique<PrefixCache>(budget_bytes);
+}
 
-    std::string tagged_prompt;
-    if (chat->is_first_prompt) {
-        tagged_prompt = prompt_utils.get_prompt_with_tag(sys_prompt, user_prompt);
-        chat->is_first_prompt = false; // mark first turn done
-    } else {
-        tagged_prompt = prompt_utils.get_subseq_prompt_with_tag(user_prompt);
+ChatManager::PooledDialogue ChatManager::acquire_pooled_dialogue() {
+    std::unique_lock<std::mutex> lk(m_pool_mu);
+    if (m_pool_size == 0) {
+        throw std::runtime_error("Dialogue pool is empty; call create_dialogue_pool() first.");
     }
+    CHATAPP_TRACE_SPAN("pool_wait");
+    const Clock::time_point start = m_metrics ? Clock::now() : Clock::time_point{};
+    m_pool_cv.wait(lk, [this] { return !m_pool_free.empty(); });
+    if (m_metrics) m_metrics->pool_wait_seconds.observe(SecondsSince(start));
 
-    CallbackWrapper wrapper{callback};
-
-    Genie_Status_t status = GenieDialog_query(
-                                chat->m_dialog_handle,
-                                tagged_prompt.c_str(),
-                                GENIE_DIALOG_SENTENCE_COMPLETE,
-                                trampoline,
-                                &wrapper);
+    std::string dialogue_id = std::move(m_pool_free.front());
+    m_pool_free.pop_front();
+    return PooledDialogue(this, std::move(dialogue_id));
+}
 
-    if (status != GENIE_STATUS_SUCCESS) {
-        throw std::runtime_error("Failed to get response from GenieDialog.");
+void ChatManager::release_pooled_dialogue(const std::string& dialogue_id) {
+    {
+        std::lock_guard<std::mutex> lk(m_pool_mu);
+        m_pool_free.push_back(dialogue_id);
     }
+    m_pool_cv.notify_one();
+}
 
-    if (!chat->is_stateful) {
-        GenieDialog_reset(chat->m_dialog_handle);
+GenerationResult ChatManager::query(const std::string& dialogue_id,
+                                    const std::string& sys_prompt,
+                                    const std::string& user_prompt,
+                                    ResponseCallback callback,
+                                    const GenerationParams& params,
+                                    const std::atomic<bool>* cancel)
+{
+    auto chat = get_dialogue(dialogue_id);
+    TimedLock chat_lk(chat->mu, m_metrics);
+    const Clock::time_point start = Clock::now();
+
+    // A pooled dialog serves unrelated requests next, so it must come back
+    // empty however this one ends; otherwise the next request would skip its
+    // system prompt and continue this one's context.
+    auto reset_stateless = [&] {
+        if (chat->is_stateful) return;
+        CHATAPP_TRACE_SPAN("dialog_reset");
+        chat->m_dialog->reset();
         chat->is_first_prompt = true; // reset for next stateless round
+    };
+
+    llm::prompt::PromptUtils prompt_utils(m_model_type);
+
+    GenerationResult result;
+    size_t prefix_bytes = 0;
+    size_t prefix_prefilled_bytes = 0;
+    try {
+        std::string tagged_prompt;
+        if (chat->is_first_prompt) {
+            const std::string prefix =
+                m_prefix_cache ? prompt_utils.get_system_prefix_with_tag(sys_prompt) : std::string();
+            const PrefixLoad load = m_prefix_cache ? load_system_prefix(*chat, prefix) : PrefixLoad::Failed;
+            if (load != PrefixLoad::Failed) {
+                prefix_bytes = prefix.size();
+                if (load == PrefixLoad::Prefilled) prefix_prefilled_bytes = prefix.size();
+                CHATAPP_TRACE_SPAN("prompt_tagging");
+                tagged_prompt = prompt_utils.get_user_suffix_with_tag(user_prompt);
+            } else {
+                CHATAPP_TRACE_SPAN("prompt_tagging");
+                tagged_prompt = prompt_utils.get_prompt_with_tag(sys_prompt, user_prompt);
+            }
+            chat->is_first_prompt = false; // mark first turn done
+        } else {
+            CHATAPP_TRACE_SPAN("prompt_tagging");
+            tagged_prompt = prompt_utils.get_subseq_prompt_with_tag(user_prompt);
+        }
+
+        result = run_query(*chat, tagged_prompt, callback, params, cancel, start);
+    } catch (...) {
+        reset_stateless();
+        throw;
     }
+    result.prompt_tokens += prefix_bytes / c_bytes_per_token;
+    result.prefilled_bytes += prefix_prefilled_bytes;
+
+    reset_stateless();
+    return result;
 }
 
-void ChatManager::user_query(const std::string& dialogue_id,
-                             const std::string& user_prompt,
-                             GenieResponseCallback callback)
+GenerationResult ChatManager::user_query(const std::string& dialogue_id,
+                                         const std::string& user_prompt,
+                                         ResponseCallback callback,
+                                         const GenerationParams& params,
+                                         const std::atomic<bool>* cancel)
 {
     auto chat = get_dialogue(dialogue_id);
+    TimedLock chat_lk(chat->mu, m_metrics);
+    const Clock::time_point start = Clock::now();
 
     if (!chat->is_stateful) {
         throw std::runtime_error("user_query() is only valid for stateful sessions.");
@@ -139,28 +233,165 @@ void ChatManager::user_query(const std::string& dialogue_id,
         throw std::runtime_error("Must call query() with system prompt before user_query() in stateful mode.");
     }
 
-    llm::prompt::PromptUtils prompt_utils(llm::prompt::ModelType::Llama3);
+    llm::prompt::PromptUtils prompt_utils(m_model_type);
     std::string tagged_prompt =
         prompt_utils.get_subseq_prompt_with_tag(user_prompt);
 
-    CallbackWrapper wrapper{callback};
+    return run_query(*chat, tagged_prompt, callback, params, cancel, start);
+}
+
+/// Bring the dialog to the state right after the tagged system prompt
+/// `prefix`, restoring a cached snapshot if there is one and prefilling
+/// (then snapshotting) otherwise.
+ChatManager::PrefixLoad ChatManager::load_system_prefix(GenieChat& chat, const std::string& prefix)
+{
+    CHATAPP_TRACE_SPAN("prefix_load");
+    if (auto state = m_prefix_cache->lookup(m_model_type, prefix)) {
+        if (chat.m_dialog->restore_state(*state)) {
+            return PrefixLoad::Restored;
+        }
+        chat.m_dialog->reset();
+        return PrefixLoad::Failed;
+    }
+
+    if (!chat.m_dialog->prefill(prefix)) {
+        chat.m_dialog->reset();
+        return PrefixLoad::Failed;
+    }
+    m_prefix_cache->insert(m_model_type, prefix, chat.m_dialog->save_state());
+    return PrefixLoad::Prefilled;
+}
+
+GenerationResult ChatManager::run_query(GenieChat& chat,
+                                        const std::string& tagged_prompt,
+                                        const ResponseCallback& callback,
+                                        const GenerationParams& params,
+                                        const std::atomic<bool>* cancel,
+                                        Clock::time_point start)
+{
+    if (!chat.m_dialog->set_sampling(params)) {
+        throw std::runtime_error("Failed to apply sampler config to GenieDialog.");
+    }
 
-    Genie_Status_t status = GenieDialog_query(
-                                chat->m_dialog_handle,
-                                tagged_prompt.c_str(),
-                                GENIE_DIALOG_SENTENCE_COMPLETE,
-                                trampoline,
-                                &wrapper);
+    GenerationResult result;
+    result.prompt_tokens = tagged_prompt.size() / c_bytes_per_token;
+    result.prefilled_bytes = tagged_prompt.size();
+    Clock::time_point first_token;
+    Clock::time_point last_token;
+    StopSequenceMatcher stop(params.stop);
+    JsonObjectTracker json_tracker;
+    bool stopping = false; // we asked the dialog to abort
+    bool begun = false;
+    bool ended = false;
 
-    if (status != GENIE_STATUS_SUCCESS) {
+    auto emit = [&](const char* text) {
+        if (*text == '\0') return;
+        callback(text, begun ? SentenceCode::Continue : SentenceCode::Begin);
+        begun = true;
+    };
+    auto finish = [&](SentenceCode code) {
+        if (ended) return;
+        // Held-back text lies past the closing brace once the JSON is done.
+        if (!stop.empty() && !json_tracker.complete()) emit(stop.flush().c_str());
+        ended = true;
+        callback("", code);
+    };
+
+    auto cancel_requested = [&] {
+        if (!cancel || !cancel->load(std::memory_order_relaxed)) return false;
+        result.finish_reason = FinishReason::Aborted;
+        stopping = true;
+        chat.m_dialog->abort();
+        finish(SentenceCode::Abort);
+        return true;
+    };
+
+    auto on_token = [&](const char* text, SentenceCode code) {
+        if (stopping || ended) {
+            return; // tokens produced before the abort took effect
+        }
+        if (code == SentenceCode::Abort) {
+            result.finish_reason = FinishReason::Aborted;
+            finish(SentenceCode::Abort);
+            return;
+        }
+        if (cancel_requested()) return;
+
+        if (*text != '\0') {
+            last_token = Clock::now();
+            if (result.generated_tokens++ == 0) first_token = last_token;
+            if (stop.empty() && !params.stop_at_json_end) {
+                emit(text); // fast path: no copy
+            } else {
+                std::string out = stop.empty() ? std::string(text) : stop.feed(text);
+                if (params.stop_at_json_end) {
+                    const size_t end = json_tracker.feed(out);
+                    if (end != JsonObjectTracker::npos) out.resize(end);
+                }
+                emit(out.c_str());
+            }
+        }
+        if (cancel_requested()) return; // the callback may have just seen its client go
+
+        if (json_tracker.complete()) {
+            result.finish_reason = FinishReason::JsonComplete;
+            if (params.max_new_tokens > result.generated_tokens) {
+                result.tokens_saved = params.max_new_tokens - result.generated_tokens;
+            }
+        } else if (stop.stopped()) {
+            result.finish_reason = FinishReason::StopSequence;
+        } else if (params.max_new_tokens != 0 &&
+                   result.generated_tokens >= params.max_new_tokens) {
+            result.finish_reason = FinishReason::MaxTokens;
+        } else {
+            if (code == SentenceCode::End || code == SentenceCode::Complete) {
+                finish(SentenceCode::End);
+            }
+            return;
+        }
+
+        stopping = true;
+        chat.m_dialog->abort();
+        finish(SentenceCode::End);
+    };
+
+    // An aborted query may report failure; that is expected when we stopped it.
+    const Clock::time_point query_start = Clock::now();
+    if (cancel && cancel->load(std::memory_order_relaxed)) {
+        // Cancelled while waiting for the dialog: skip the prefill entirely
+        result.finish_reason = FinishReason::Aborted;
+        finish(SentenceCode::Abort);
+    } else if (!chat.m_dialog->query(tagged_prompt, on_token) && !stopping) {
         throw std::runtime_error("Failed to get response from GenieDialog.");
     }
+    finish(SentenceCode::End);
+
+    const Clock::time_point query_end = Clock::now();
+    if (result.generated_tokens > 0) {
+        result.prefill_us = MicrosBetween(start, first_token);
+        result.decode_us = MicrosBetween(first_token, last_token);
+    } else {
+        result.prefill_us = MicrosBetween(start, query_end);
+    }
+    if (const uint64_t request = Tracer::current_request()) {
+        Tracer& tracer = Tracer::instance();
+        const Clock::time_point prefill_end = result.generated_tokens > 0 ? first_token : query_end;
+        tracer.record("prefill", request, query_start, prefill_end);
+        if (result.generated_tokens > 0) tracer.record("decode", request, first_token, query_end);
+    }
+    return result;
 }
 
 std::shared_ptr<GenieChat> ChatManager::get_dialogue(const std::string& dialogue_id) {
-    auto it = m_sessions.find(dialogue_id);
-    if (it == m_sessions.end()) {
+    auto& shard = shard_for(dialogue_id);
+    std::lock_guard<std::mutex> lk(shard.mu);
+    auto it = shard.sessions.find(dialogue_id);
+    if (it == shard.sessions.end()) {
         throw std::runtime_error("Dialogue ID not found: " + dialogue_id);
     }
     return it->second;
 }
+
+ChatManager::SessionShard& ChatManager::shard_for(const std::string& dialogue_id) {
+    return m_shards[std::hash<std::string>{}(dialogue_id) % c_session_shards];
+}
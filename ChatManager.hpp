@@ -6,54 +6,169 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
 #include <functional>
-#include "GenieDialog.h"   // Genie SDK types
+#include "InferenceBackend.hpp"
+#include "PrefixCache.hpp"
 #include "PromptHandler.hpp"
 
+class ServerMetrics;
+
 // ---------------------------------------------------------------------
 // GenieChat: wrapper for a single dialog session
 // ---------------------------------------------------------------------
 class GenieChat {
 public:
-    GenieDialog_Handle_t m_dialog_handle = nullptr;
+    std::unique_ptr<InferenceDialog> m_dialog;
     bool is_stateful = false;
     bool is_first_prompt = true;
+    std::mutex mu; ///< Held for the duration of a query on this dialog
+
+    GenieChat(InferenceBackend& backend, bool stateful);
+};
+
+/// Why a generation ended.
+enum class FinishReason {
+    EndOfTurn,    ///< Model emitted its end-of-turn token
+    MaxTokens,    ///< max_new_tokens reached
+    StopSequence, ///< A requested stop sequence was produced
+    JsonComplete, ///< Top-level JSON object closed (stop_at_json_end)
+    Aborted       ///< Aborted from outside (e.g. client went away)
+};
 
-    GenieChat(GenieDialogConfig_Handle_t config_handle, bool stateful);
-    ~GenieChat();
+const char* to_string(FinishReason reason);
+
+struct GenerationResult {
+    size_t generated_tokens = 0;
+    size_t tokens_saved = 0; ///< Unused max_new_tokens budget when ended at JSON close
+    FinishReason finish_reason = FinishReason::EndOfTurn;
+    size_t prompt_tokens = 0; ///< Tagged prompt incl. system prefix, estimated from its bytes
+    uint64_t prefill_us = 0;  ///< Dialog lock acquired until the first token (prefix restore included)
+    uint64_t decode_us = 0;   ///< First token until the last one
+    size_t prefilled_bytes = 0; ///< Prompt bytes actually prefilled; excludes a restored system prefix
 };
 
 // ---------------------------------------------------------------------
-// ChatManager: manages multiple GenieChat sessions
+// ChatManager: manages multiple GenieChat sessions (thread-safe)
 // ---------------------------------------------------------------------
 class ChatManager {
 public:
-    using GenieResponseCallback =
-        std::function<void(const char*, GenieDialog_SentenceCode_t)>;
+    using ResponseCallback = InferenceDialog::TokenCallback;
+
+    /// RAII checkout of a pooled stateless dialogue; returned on destruction.
+    class PooledDialogue {
+    public:
+        PooledDialogue(ChatManager* manager, std::string dialogue_id)
+            : m_manager(manager), m_id(std::move(dialogue_id)) {}
+        PooledDialogue(PooledDialogue&& other) noexcept
+            : m_manager(other.m_manager), m_id(std::move(other.m_id)) {
+            other.m_manager = nullptr;
+        }
+        PooledDialogue(const PooledDialogue&) = delete;
+        PooledDialogue& operator=(const PooledDialogue&) = delete;
+        PooledDialogue& operator=(PooledDialogue&&) = delete;
+        ~PooledDialogue() {
+            if (m_manager) m_manager->release_pooled_dialogue(m_id);
+        }
+
+        const std::string& id() const { return m_id; }
 
-    explicit ChatManager(const std::string& config_json);
+    private:
+        ChatManager* m_manager;
+        std::string m_id;
+    };
+
+    explicit ChatManager(std::unique_ptr<InferenceBackend> backend);
     ~ChatManager();
 
     std::string create_new_dialogue(bool is_stateful = false);
     void remove_dialogue(const std::string& dialogue_id);
 
-    /// First-turn query (requires sys + user prompt)
-    void query(const std::string& dialogue_id,
-               const std::string& sys_prompt,
-               const std::string& user_prompt,
-               GenieResponseCallback callback);
+    /// Pre-create `size` stateless dialogues that requests check out.
+    void create_dialogue_pool(size_t size);
+
+    /// Block until a pooled dialogue is free and check it out.
+    PooledDialogue acquire_pooled_dialogue();
+
+    size_t pool_size() const { return m_pool_size; }
+
+    /// Cache system-prompt prefill state, bounded by `budget_bytes` of
+    /// snapshots. Call before serving requests.
+    void enable_prefix_cache(size_t budget_bytes);
+
+    /// nullptr unless enable_prefix_cache() was called.
+    const PrefixCache* prefix_cache() const { return m_prefix_cache.get(); }
+
+    /// Record pool and dialogue lock wait/hold times into `metrics`,
+    /// which must outlive the manager. Call before serving requests.
+    void set_metrics(ServerMetrics* metrics) { m_metrics = metrics; }
+
+    /// First-turn query (requires sys + user prompt). `params` caps the
+    /// output length, sets the sampler and ends generation at stop
+    /// sequences (which are not passed to `callback`). Once `*cancel` is
+    /// set (typically by the callback when its client has gone away) the
+    /// dialog is aborted and the query returns FinishReason::Aborted.
+    GenerationResult query(const std::string& dialogue_id,
+                           const std::string& sys_prompt,
+                           const std::string& user_prompt,
+                           ResponseCallback callback,
+                           const GenerationParams& params = {},
+                           const std::atomic<bool>* cancel = nullptr);
 
     /// Subsequent query for stateful dialogues (user only)
-    void user_query(const std::string& dialogue_id,
-                    const std::string& user_prompt,
-                    GenieResponseCallback callback);
+    GenerationResult user_query(const std::string& dialogue_id,
+                                const std::string& user_prompt,
+                                ResponseCallback callback,
+                                const GenerationParams& params = {},
+                                const std::atomic<bool>* cancel = nullptr);
+
+    const char* backend_name() const { return m_backend->name(); }
+    llm::prompt::ModelType model_type() const { return m_model_type; }
 
 private:
+    static constexpr size_t c_session_shards = 16;
+
+    struct SessionShard {
+        std::mutex mu;
+        std::unordered_map<std::string, std::shared_ptr<GenieChat>> sessions;
+    };
+
+    /// How load_system_prefix() brought the dialog to the prefix state.
+    enum class PrefixLoad {
+        Failed,    ///< Dialog left empty; send the full prompt instead
+        Restored,  ///< From a cached snapshot, without prefill
+        Prefilled  ///< Prefilled now and snapshotted
+    };
+
     std::shared_ptr<GenieChat> get_dialogue(const std::string& dialogue_id);
+    PrefixLoad load_system_prefix(GenieChat& chat, const std::string& prefix);
+    GenerationResult run_query(GenieChat& chat,
+                               const std::string& tagged_prompt,
+                               const ResponseCallback& callback,
+                               const GenerationParams& params,
+                               const std::atomic<bool>* cancel,
+                               std::chrono::steady_clock::time_point start);
+    SessionShard& shard_for(const std::string& dialogue_id);
+    void release_pooled_dialogue(const std::string& dialogue_id);
+
+    std::unique_ptr<InferenceBackend> m_backend;
+    llm::prompt::ModelType m_model_type = llm::prompt::ModelType::Llama3;
+    std::unique_ptr<PrefixCache> m_prefix_cache;
+    ServerMetrics* m_metrics = nullptr;
+    std::array<SessionShard, c_session_shards> m_shards;
+    std::atomic<uint64_t> m_next_id{0};
 
-    GenieDialogConfig_Handle_t m_config_handle = nullptr;
-    std::unordered_map<std::string, std::shared_ptr<GenieChat>> m_sessions;
+    std::mutex m_pool_mu;
+    std::condition_variable m_pool_cv;
+    std::deque<std::string> m_pool_free;
+    size_t m_pool_size = 0;
 };
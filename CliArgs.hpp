@@ -0,0 +1,61 @@
+// ---------------------------------------------------------------------
+// CliArgs.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/// Parse the numeric value of command line `option` into `out`. The whole
+/// of `text` must be a number in range for T (in `base`, for integers);
+/// otherwise an error naming the option is printed and false returned,
+/// leaving `out` unchanged.
+template <typename T>
+bool ParseOptionValue(std::string_view option, const std::string& text, T& out, int base = 10) {
+    static_assert(std::is_arithmetic_v<T>, "numeric options only");
+    try {
+        size_t used = 0;
+        T value{};
+        if constexpr (std::is_floating_point_v<T>) {
+            value = static_cast<T>(std::stod(text, &used));
+        } else if constexpr (std::is_signed_v<T>) {
+            const long long v = std::stoll(text, &used, base);
+            if (v < std::numeric_limits<T>::min() || v > std::numeric_limits<T>::max()) {
+                throw std::out_of_range(text);
+            }
+            value = static_cast<T>(v);
+        } else {
+            // stoull accepts "-1" and wraps it; a count is never negative
+            if (text.find('-') != std::string::npos) throw std::invalid_argument(text);
+            const unsigned long long v = std::stoull(text, &used, base);
+            if (v > std::numeric_limits<T>::max()) throw std::out_of_range(text);
+            value = static_cast<T>(v);
+        }
+        if (used == text.size()) {
+            out = value;
+            return true;
+        }
+    } catch (const std::exception&) {
+        // reported below
+    }
+    std::cerr << "Invalid value for " << option << ": " << text << "\n";
+    return false;
+}
+
+/// Durations are given as a count of `Period` units.
+template <typename Rep, typename Period>
+bool ParseOptionValue(std::string_view option, const std::string& text,
+                      std::chrono::duration<Rep, Period>& out) {
+    Rep count{};
+    if (!ParseOptionValue(option, text, count)) return false;
+    out = std::chrono::duration<Rep, Period>(count);
+    return true;
+}
@@ -0,0 +1,615 @@
+// ---------------------------------------------------------------------
+// EventLoopServer.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "EventLoopServer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    constexpr int c_max_events = 64;
+    constexpr int c_sweep_interval_ms = 1000;
+    constexpr size_t c_read_chunk = 16 << 10;
+
+    std::string StatusLine(int status) {
+        return "HTTP/1.1 " + std::to_string(status) + " " + httplib::status_message(status) + "\r\n";
+    }
+
+    void AppendHeaders(std::string& out, const httplib::Headers& headers) {
+        for (const auto& [key, value] : headers) {
+            out += key;
+            out += ": ";
+            out += value;
+            out += "\r\n";
+        }
+    }
+
+    std::string Trim(const std::string& s) {
+        const size_t begin = s.find_first_not_of(" \t");
+        if (begin == std::string::npos) return {};
+        const size_t end = s.find_last_not_of(" \t");
+        return s.substr(begin, end - begin + 1);
+    }
+
+    bool IEquals(const std::string& a, const char* b) {
+        return strcasecmp(a.c_str(), b) == 0;
+    }
+} // namespace
+
+// ---------------------------------------------------------------------
+// Mailbox: exchanges with output for the loop, plus its wakeup eventfd
+// ---------------------------------------------------------------------
+/// Shared with every Exchange so producers can still post (into the
+/// void) after the loop has gone.
+struct EventLoopServer::Mailbox {
+    Mailbox() : event_fd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+        if (event_fd < 0) {
+            throw std::runtime_error(std::string("eventfd failed: ") + std::strerror(errno));
+        }
+    }
+    ~Mailbox() { ::close(event_fd); }
+
+    void notify(std::shared_ptr<Exchange> exchange) {
+        {
+            std::lock_guard<std::mutex> lk(mu);
+            if (stopped) return;
+            ready.push_back(std::move(exchange));
+        }
+        const uint64_t one = 1;
+        [[maybe_unused]] const ssize_t n = ::write(event_fd, &one, sizeof(one));
+    }
+
+    const int event_fd;
+    std::mutex mu;
+    std::vector<std::shared_ptr<Exchange>> ready;
+    bool stopped = false;
+};
+
+// ---------------------------------------------------------------------
+// Exchange Implementation
+// ---------------------------------------------------------------------
+EventLoopServer::Exchange::Exchange(std::shared_ptr<Mailbox> mailbox, int fd,
+                                    httplib::Request request, bool keep_alive)
+    : m_mailbox(std::move(mailbox)), m_fd(fd), m_request(std::move(request)), m_keep_alive(keep_alive)
+{
+}
+
+void EventLoopServer::Exchange::respond(const httplib::Response& res) {
+    const int status = res.status == -1 ? 200 : res.status; // httplib's "unset"
+    std::string out = StatusLine(status);
+    AppendHeaders(out, m_extra_headers);
+    AppendHeaders(out, res.headers);
+    out += "Content-Length: " + std::to_string(res.body.size()) + "\r\n";
+    out += m_keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    out += res.body;
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        if (m_started) return;
+        m_started = true;
+        m_status = status;
+    }
+    post(std::move(out), true);
+}
+
+void EventLoopServer::Exchange::begin_stream(int status, const std::string& content_type,
+                                             const httplib::Headers& headers) {
+    std::string out = StatusLine(status);
+    out += "Content-Type: " + content_type + "\r\n";
+    AppendHeaders(out, m_extra_headers);
+    AppendHeaders(out, headers);
+    out += "Transfer-Encoding: chunked\r\n";
+    out += m_keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        if (m_started) return;
+        m_started = true;
+        m_status = status;
+    }
+    post(std::move(out), false);
+}
+
+bool EventLoopServer::Exchange::write(const char* data, size_t len) {
+    if (closed()) return false;
+    if (len == 0) return true; // a zero-size chunk would end the body
+
+    char size_line[24];
+    const int n = std::snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+    std::string chunk;
+    chunk.reserve(static_cast<size_t>(n) + len + 2);
+    chunk.append(size_line, static_cast<size_t>(n));
+    chunk.append(data, len);
+    chunk += "\r\n";
+    post(std::move(chunk), false);
+    return !closed();
+}
+
+void EventLoopServer::Exchange::finish(const httplib::Headers& trailers) {
+    std::string out = "0\r\n";
+    AppendHeaders(out, trailers);
+    out += "\r\n";
+    post(std::move(out), true);
+}
+
+void EventLoopServer::Exchange::abort() {
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        m_aborted = true;
+    }
+    post({}, true);
+}
+
+size_t EventLoopServer::Exchange::pending_bytes() const {
+    std::lock_guard<std::mutex> lk(m_mu);
+    return m_out.size();
+}
+
+int EventLoopServer::Exchange::status() const {
+    std::lock_guard<std::mutex> lk(m_mu);
+    return m_status;
+}
+
+void EventLoopServer::Exchange::post(std::string bytes, bool complete) {
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        if (m_complete || closed()) return;
+        m_out += bytes;
+        m_complete = complete;
+        wake = !m_scheduled;
+        m_scheduled = true;
+    }
+    if (wake) {
+        m_mailbox->notify(shared_from_this());
+    }
+}
+
+// ---------------------------------------------------------------------
+// Loop: one epoll set, its listening socket and its connections
+// ---------------------------------------------------------------------
+class EventLoopServer::Loop {
+public:
+    /// `tick` is nullptr for every loop but the one that runs it.
+    Loop(const EventLoopConfig& config, const Handler& handler, std::atomic<size_t>& connections,
+         const Tick* tick, std::chrono::milliseconds tick_interval)
+        : m_config(config), m_handler(handler), m_connection_count(connections),
+          m_tick(tick), m_tick_interval(tick_interval),
+          m_mailbox(std::make_shared<Mailbox>())
+    {
+        m_epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll_fd < 0) {
+            throw std::runtime_error(std::string("epoll_create1 failed: ") + std::strerror(errno));
+        }
+    }
+
+    ~Loop() {
+        stop();
+        if (m_listen_fd >= 0) ::close(m_listen_fd);
+        ::close(m_epoll_fd);
+    }
+
+    void listen(const std::string& host, int port) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+        addrinfo* addrs = nullptr;
+        const std::string service = std::to_string(port);
+        const int rc = ::getaddrinfo(host.empty() ? nullptr : host.c_str(), service.c_str(), &hints, &addrs);
+        if (rc != 0) {
+            throw std::runtime_error("Cannot resolve " + host + ": " + ::gai_strerror(rc));
+        }
+
+        std::string error = "no usable address";
+        for (addrinfo* ai = addrs; ai && m_listen_fd < 0; ai = ai->ai_next) {
+            const int fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd < 0) continue;
+            const int yes = 1;
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+            if (::bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && ::listen(fd, SOMAXCONN) == 0) {
+                m_listen_fd = fd;
+            } else {
+                error = std::strerror(errno);
+                ::close(fd);
+            }
+        }
+        ::freeaddrinfo(addrs);
+        if (m_listen_fd < 0) {
+            throw std::runtime_error("Cannot listen on " + host + ":" + service + ": " + error);
+        }
+
+        add(m_listen_fd, EPOLLIN);
+        add(m_mailbox->event_fd, EPOLLIN);
+    }
+
+    void start() {
+        m_thread = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        if (!m_thread.joinable()) return;
+        m_stopping.store(true, std::memory_order_relaxed);
+        const uint64_t one = 1;
+        [[maybe_unused]] const ssize_t n = ::write(m_mailbox->event_fd, &one, sizeof(one));
+        m_thread.join();
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct Connection {
+        int fd = -1;
+        std::string in;                       ///< Received, not yet parsed
+        std::string out;                      ///< Taken from the exchange, not yet sent
+        size_t out_sent = 0;
+        std::shared_ptr<Exchange> exchange;   ///< Request being answered
+        bool response_done = false;           ///< Exchange has queued its last byte
+        bool close_after = false;             ///< Close once `out` is sent
+        bool sent_continue = false;           ///< "100 Continue" sent for the pending request
+        bool want_write = false;              ///< EPOLLOUT registered
+        clock::time_point last_active;
+    };
+
+    void add(int fd, uint32_t events) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        ::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    void run() {
+        epoll_event events[c_max_events];
+        clock::time_point last_sweep = clock::now();
+        clock::time_point last_tick = last_sweep;
+        const int wait_ms = m_tick ? std::clamp(static_cast<int>(m_tick_interval.count()), 1, c_sweep_interval_ms)
+                                   : c_sweep_interval_ms;
+        while (!m_stopping.load(std::memory_order_relaxed)) {
+            const int n = ::epoll_wait(m_epoll_fd, events, c_max_events, wait_ms);
+            for (int i = 0; i < n; ++i) {
+                const int fd = events[i].data.fd;
+                if (fd == m_listen_fd) {
+                    accept_all();
+                } else if (fd == m_mailbox->event_fd) {
+                    drain_mailbox();
+                } else {
+                    auto it = m_connections.find(fd);
+                    if (it == m_connections.end()) continue;
+                    Connection& conn = it->second;
+                    if (events[i].events & EPOLLOUT) {
+                        if (!flush(conn)) continue;
+                        next_request(conn);
+                    }
+                    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP)) {
+                        on_readable(conn);
+                    }
+                }
+            }
+
+            const clock::time_point now = clock::now();
+            if (m_tick && now - last_tick >= m_tick_interval) {
+                last_tick = now;
+                try {
+                    (*m_tick)();
+                } catch (...) {
+                    // A failing tick must not take the loop down
+                }
+            }
+            if (now - last_sweep >= std::chrono::milliseconds(c_sweep_interval_ms)) {
+                last_sweep = now;
+                sweep_idle(now);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lk(m_mailbox->mu);
+            m_mailbox->stopped = true;
+            m_mailbox->ready.clear();
+        }
+        while (!m_connections.empty()) {
+            close(m_connections.begin()->second);
+        }
+    }
+
+    void accept_all() {
+        for (;;) {
+            const int fd = ::accept4(m_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return; // EAGAIN, or out of descriptors: retry on the next event
+            const int yes = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+            Connection& conn = m_connections[fd];
+            conn.fd = fd;
+            conn.last_active = clock::now();
+            add(fd, EPOLLIN | EPOLLRDHUP);
+            m_connection_count.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void drain_mailbox() {
+        uint64_t count;
+        [[maybe_unused]] const ssize_t n = ::read(m_mailbox->event_fd, &count, sizeof(count));
+
+        std::vector<std::shared_ptr<Exchange>> ready;
+        {
+            std::lock_guard<std::mutex> lk(m_mailbox->mu);
+            ready.swap(m_mailbox->ready);
+        }
+        for (const auto& exchange : ready) {
+            auto it = m_connections.find(exchange->m_fd);
+            // The descriptor may have been closed and reused since
+            if (it == m_connections.end() || it->second.exchange.get() != exchange.get()) continue;
+            pump(it->second);
+        }
+    }
+
+    /// Move the exchange's output to the connection and send what we can.
+    void pump(Connection& conn) {
+        bool aborted;
+        {
+            Exchange& exchange = *conn.exchange;
+            std::lock_guard<std::mutex> lk(exchange.m_mu);
+            aborted = exchange.m_aborted;
+            conn.out += exchange.m_out;
+            exchange.m_out.clear();
+            exchange.m_scheduled = false;
+            conn.response_done = exchange.m_complete;
+        }
+        if (aborted) {
+            close(conn);
+            return;
+        }
+        if (!flush(conn)) return;
+        next_request(conn);
+    }
+
+    /// Write pending output. False if the connection was closed.
+    bool flush(Connection& conn) {
+        while (conn.out_sent < conn.out.size()) {
+            const ssize_t n = ::send(conn.fd, conn.out.data() + conn.out_sent,
+                                     conn.out.size() - conn.out_sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                conn.out_sent += static_cast<size_t>(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                set_want_write(conn, true);
+                return true;
+            }
+            close(conn);
+            return false;
+        }
+        conn.out.clear();
+        conn.out_sent = 0;
+        conn.last_active = clock::now();
+        set_want_write(conn, false);
+
+        if (conn.close_after && (!conn.exchange || conn.response_done)) {
+            close(conn);
+            return false;
+        }
+        return true;
+    }
+
+    void set_want_write(Connection& conn, bool want) {
+        if (conn.want_write == want) return;
+        conn.want_write = want;
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP | (want ? EPOLLOUT : 0u);
+        ev.data.fd = conn.fd;
+        ::epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, conn.fd, &ev);
+    }
+
+    void on_readable(Connection& conn) {
+        char buf[c_read_chunk];
+        for (;;) {
+            const ssize_t n = ::recv(conn.fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                conn.in.append(buf, static_cast<size_t>(n));
+                if (conn.in.size() > m_config.max_header_bytes + m_config.max_body_bytes) {
+                    close(conn); // pipelining far ahead of us
+                    return;
+                }
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            close(conn); // peer closed or error: abandon any response in progress
+            return;
+        }
+        conn.last_active = clock::now();
+        next_request(conn);
+    }
+
+    /// Once the current response is fully sent, start the next buffered request.
+    void next_request(Connection& conn) {
+        if (conn.exchange) {
+            if (!conn.response_done || !conn.out.empty()) return;
+            conn.exchange.reset();
+            conn.response_done = false;
+        }
+        parse_request(conn);
+    }
+
+    void reject(Connection& conn, int status, const char* message) {
+        httplib::Response res;
+        res.status = status;
+        res.set_content(message, "text/plain");
+        conn.close_after = true;
+        conn.exchange = std::make_shared<Exchange>(m_mailbox, conn.fd, httplib::Request{}, false);
+        conn.exchange->respond(res);
+    }
+
+    void parse_request(Connection& conn) {
+        const size_t head_end = conn.in.find("\r\n\r\n");
+        if (head_end == std::string::npos) {
+            if (conn.in.size() > m_config.max_header_bytes) {
+                reject(conn, 431, "Error: request header too large");
+            }
+            return;
+        }
+
+        httplib::Request req;
+        size_t line_end = conn.in.find("\r\n");
+        {
+            const std::string line = conn.in.substr(0, line_end);
+            const size_t sp1 = line.find(' ');
+            const size_t sp2 = line.rfind(' ');
+            if (sp1 == std::string::npos || sp2 == sp1) {
+                reject(conn, 400, "Error: malformed request line");
+                return;
+            }
+            req.method = line.substr(0, sp1);
+            req.target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+            req.version = line.substr(sp2 + 1);
+            const size_t query = req.target.find('?');
+            req.path = req.target.substr(0, query);
+            if (query != std::string::npos) {
+                httplib::detail::parse_query_text(req.target.substr(query + 1), req.params);
+            }
+        }
+        while (line_end < head_end) {
+            const size_t begin = line_end + 2;
+            line_end = conn.in.find("\r\n", begin);
+            const std::string line = conn.in.substr(begin, line_end - begin);
+            const size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                reject(conn, 400, "Error: malformed header");
+                return;
+            }
+            req.headers.emplace(Trim(line.substr(0, colon)), Trim(line.substr(colon + 1)));
+        }
+
+        if (req.has_header("Transfer-Encoding")) {
+            reject(conn, 501, "Error: chunked request bodies are not supported");
+            return;
+        }
+        size_t body_size = 0;
+        if (req.has_header("Content-Length")) {
+            try {
+                body_size = std::stoull(req.get_header_value("Content-Length"));
+            } catch (const std::exception&) {
+                reject(conn, 400, "Error: invalid Content-Length");
+                return;
+            }
+        }
+        if (body_size > m_config.max_body_bytes) {
+            reject(conn, 413, "Error: request body too large");
+            return;
+        }
+
+        const size_t body_begin = head_end + 4;
+        if (conn.in.size() < body_begin + body_size) {
+            if (!conn.sent_continue && IEquals(req.get_header_value("Expect"), "100-continue")) {
+                conn.sent_continue = true;
+                conn.out += "HTTP/1.1 100 Continue\r\n\r\n";
+                flush(conn);
+            }
+            return;
+        }
+        req.body = conn.in.substr(body_begin, body_size);
+        conn.in.erase(0, body_begin + body_size);
+        conn.sent_continue = false;
+
+        const std::string connection = req.get_header_value("Connection");
+        const bool keep_alive = req.version == "HTTP/1.1" ? !IEquals(connection, "close")
+                                                          : IEquals(connection, "keep-alive");
+        conn.close_after = !keep_alive;
+        conn.exchange = std::make_shared<Exchange>(m_mailbox, conn.fd, std::move(req), keep_alive);
+
+        // Copy: answers always come back through the mailbox, never by
+        // re-entering this connection from inside the handler.
+        const auto exchange = conn.exchange;
+        try {
+            m_handler(exchange);
+        } catch (const std::exception& e) {
+            httplib::Response res;
+            res.status = 500;
+            res.set_content(std::string("Error: ") + e.what(), "text/plain");
+            exchange->respond(res);
+        }
+    }
+
+    void sweep_idle(clock::time_point now) {
+        std::vector<int> idle;
+        for (const auto& [fd, conn] : m_connections) {
+            if (!conn.exchange && now - conn.last_active > m_config.idle_timeout) {
+                idle.push_back(fd);
+            }
+        }
+        for (const int fd : idle) {
+            close(m_connections.at(fd));
+        }
+    }
+
+    void close(Connection& conn) {
+        if (conn.exchange) {
+            conn.exchange->m_closed.store(true, std::memory_order_release);
+        }
+        ::epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        ::close(conn.fd);
+        m_connections.erase(conn.fd);
+        m_connection_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    const EventLoopConfig& m_config;
+    const Handler& m_handler;
+    std::atomic<size_t>& m_connection_count;
+    const Tick* m_tick;
+    const std::chrono::milliseconds m_tick_interval;
+    std::shared_ptr<Mailbox> m_mailbox;
+    int m_epoll_fd = -1;
+    int m_listen_fd = -1;
+    std::unordered_map<int, Connection> m_connections;
+    std::atomic<bool> m_stopping{false};
+    std::thread m_thread;
+};
+
+// ---------------------------------------------------------------------
+// EventLoopServer Implementation
+// ---------------------------------------------------------------------
+EventLoopServer::EventLoopServer(const EventLoopConfig& config, Handler handler)
+    : m_config(config), m_handler(std::move(handler))
+{
+}
+
+EventLoopServer::~EventLoopServer()
+{
+    stop();
+}
+
+void EventLoopServer::start(const std::string& host, int port) {
+    const size_t threads = std::max<size_t>(1, m_config.threads);
+    for (size_t i = 0; i < threads; ++i) {
+        auto loop = std::make_unique<Loop>(m_config, m_handler, m_connections,
+                                           i == 0 && m_tick ? &m_tick : nullptr, m_tick_interval);
+        loop->listen(host, port);
+        m_loops.push_back(std::move(loop));
+    }
+    for (auto& loop : m_loops) {
+        loop->start();
+    }
+}
+
+void EventLoopServer::stop() {
+    for (auto& loop : m_loops) {
+        loop->stop();
+    }
+    m_loops.clear();
+}
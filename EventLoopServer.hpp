@@ -0,0 +1,137 @@
+// ---------------------------------------------------------------------
+// EventLoopServer.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "httplib.h"
+
+// ---------------------------------------------------------------------
+// EventLoopConfig
+// ---------------------------------------------------------------------
+struct EventLoopConfig {
+    size_t threads = 2;                      ///< Event loops, each with its own listening socket
+    size_t max_header_bytes = 64 << 10;      ///< Larger request heads get 431
+    size_t max_body_bytes = 1 << 20;         ///< Larger bodies get 413 (same as the httplib front end)
+    std::chrono::seconds idle_timeout{60};   ///< Keep-alive connections idle this long are closed
+};
+
+// ---------------------------------------------------------------------
+// EventLoopServer: epoll-based HTTP/1.1 front end
+// ---------------------------------------------------------------------
+/// Multiplexes many keep-alive and streaming connections on a few
+/// threads instead of one thread per connection. Every loop owns an
+/// epoll set and a SO_REUSEPORT listening socket, so the kernel spreads
+/// new connections across loops and a connection never changes thread.
+///
+/// The handler runs on the loop thread and must not block: it inspects
+/// the request and hands the Exchange to whoever produces the answer
+/// (typically an InferenceQueue job). The Exchange may be answered from
+/// any thread; bytes are buffered and written by the loop, so a slow
+/// client never stalls the producer. Linux only.
+class EventLoopServer {
+    class Loop;
+    struct Mailbox;
+
+public:
+    /// One request and its response. Always owned through shared_ptr.
+    class Exchange : public std::enable_shared_from_this<Exchange> {
+    public:
+        Exchange(std::shared_ptr<Mailbox> mailbox, int fd, httplib::Request request, bool keep_alive);
+
+        const httplib::Request& request() const { return m_request; }
+
+        /// Add a header to whichever response is started. Call before responding.
+        void add_header(std::string key, std::string value) {
+            m_extra_headers.emplace(std::move(key), std::move(value));
+        }
+
+        /// Send a complete response (status, headers, body). Once per exchange.
+        void respond(const httplib::Response& res);
+
+        /// Start a chunked response; follow with write() and finish().
+        void begin_stream(int status, const std::string& content_type,
+                          const httplib::Headers& headers = {});
+
+        /// Queue one chunk. False once the client has gone.
+        bool write(const char* data, size_t len);
+
+        /// End the chunked response, optionally with trailers.
+        void finish(const httplib::Headers& trailers = {});
+
+        /// Drop the connection without completing the response.
+        void abort();
+
+        /// True once the connection is closed; producers should stop.
+        bool closed() const { return m_closed.load(std::memory_order_acquire); }
+
+        /// Bytes queued but not yet handed to the socket.
+        size_t pending_bytes() const;
+
+        /// Status code of the response started so far, or 0 if none was.
+        int status() const;
+
+    private:
+        friend class EventLoopServer;
+
+        /// Append `bytes` to the outbox and wake the loop.
+        void post(std::string bytes, bool complete);
+
+        std::shared_ptr<Mailbox> m_mailbox;
+        const int m_fd;
+        const httplib::Request m_request;
+        const bool m_keep_alive;
+        httplib::Headers m_extra_headers;
+
+        mutable std::mutex m_mu;
+        std::string m_out;          ///< Produced, not yet taken by the loop
+        bool m_started = false;     ///< Response head queued
+        int m_status = 0;           ///< Status of the queued head
+        bool m_complete = false;    ///< Response fully queued
+        bool m_aborted = false;     ///< Close instead of completing
+        bool m_scheduled = false;   ///< Already in the mailbox
+        std::atomic<bool> m_closed{false};
+    };
+
+    using Handler = std::function<void(const std::shared_ptr<Exchange>&)>;
+    using Tick = std::function<void()>;
+
+    EventLoopServer(const EventLoopConfig& config, Handler handler);
+
+    /// Closes every connection and joins the loops.
+    ~EventLoopServer();
+
+    /// Run `tick` on the first loop's thread about every `interval`, for
+    /// work with deadlines that no request event would trigger. Like the
+    /// handler it must not block. Call before start().
+    void set_tick(std::chrono::milliseconds interval, Tick tick) {
+        m_tick_interval = interval;
+        m_tick = std::move(tick);
+    }
+
+    /// Bind `host:port` on every loop and start serving. Throws
+    /// std::runtime_error if the socket cannot be set up.
+    void start(const std::string& host, int port);
+
+    void stop();
+
+    /// Open client connections across all loops.
+    size_t connections() const { return m_connections.load(std::memory_order_relaxed); }
+
+private:
+    EventLoopConfig m_config;
+    Handler m_handler;
+    std::chrono::milliseconds m_tick_interval{0};
+    Tick m_tick;
+    std::atomic<size_t> m_connections{0};
+    std::vector<std::unique_ptr<Loop>> m_loops;
+};
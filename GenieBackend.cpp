@@ -0,0 +1,232 @@
+// ---------------------------------------------------------------------
+// GenieBackend.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "GenieBackend.hpp"
+#include "Log.hpp"
+#include <atomic>
+#include <filesystem>
+#include <stdexcept>
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+// ---------------------------------------------------------------------
+// Helper types (file-private)
+// ---------------------------------------------------------------------
+namespace {
+    SentenceCode to_sentence_code(GenieDialog_SentenceCode_t code) {
+        switch (code) {
+            case GENIE_DIALOG_SENTENCE_COMPLETE: return SentenceCode::Complete;
+            case GENIE_DIALOG_SENTENCE_BEGIN:    return SentenceCode::Begin;
+            case GENIE_DIALOG_SENTENCE_CONTINUE: return SentenceCode::Continue;
+            case GENIE_DIALOG_SENTENCE_END:      return SentenceCode::End;
+            case GENIE_DIALOG_SENTENCE_ABORT:    return SentenceCode::Abort;
+            case GENIE_DIALOG_SENTENCE_REWIND:   return SentenceCode::Rewind;
+            case GENIE_DIALOG_SENTENCE_RESUME:   return SentenceCode::Resume;
+        }
+        return SentenceCode::Continue;
+    }
+
+    struct CallbackWrapper {
+        const InferenceDialog::TokenCallback* fn;
+    };
+
+    void trampoline(const char* response_back,
+                    GenieDialog_SentenceCode_t sentence_code,
+                    const void* user_data) {
+        auto* wrapper = static_cast<const CallbackWrapper*>(user_data);
+        if (wrapper && wrapper->fn && *wrapper->fn) {
+            (*wrapper->fn)(response_back, to_sentence_code(sentence_code));
+        }
+    }
+
+    // -----------------------------------------------------------------
+    // GenieState: dialog snapshot written by GenieDialog_save
+    // -----------------------------------------------------------------
+    class GenieState : public DialogState {
+    public:
+        explicit GenieState(std::filesystem::path dir) : m_dir(std::move(dir)) {
+            std::error_code ec;
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(m_dir, ec)) {
+                if (entry.is_regular_file(ec)) m_bytes += entry.file_size(ec);
+            }
+        }
+
+        ~GenieState() override {
+            std::error_code ec;
+            std::filesystem::remove_all(m_dir, ec);
+        }
+
+        size_t size_bytes() const override { return m_bytes; }
+        const std::filesystem::path& dir() const { return m_dir; }
+
+    private:
+        std::filesystem::path m_dir;
+        size_t m_bytes = 0;
+    };
+
+    std::filesystem::path next_state_dir() {
+        static std::atomic<uint64_t> counter{0};
+        return std::filesystem::temp_directory_path() /
+               ("chatapp_state_" + std::to_string(++counter));
+    }
+
+    // -----------------------------------------------------------------
+    // GenieInferenceDialog: InferenceDialog over a GenieDialog_Handle_t
+    // -----------------------------------------------------------------
+    class GenieInferenceDialog : public InferenceDialog {
+    public:
+        GenieInferenceDialog(GenieDialogConfig_Handle_t config_handle,
+                             const GenieBackend::SamplerDefaults& defaults)
+            : m_defaults(defaults),
+              m_temperature(defaults.temperature),
+              m_top_p(defaults.top_p)
+        {
+            if (GENIE_STATUS_SUCCESS !=
+                GenieDialog_create(config_handle, &m_dialog_handle))
+            {
+                throw std::runtime_error("Failed to create Genie Dialog.");
+            }
+        }
+
+        ~GenieInferenceDialog() override {
+            if (m_dialog_handle != nullptr)
+            {
+                if (GENIE_STATUS_SUCCESS != GenieDialog_free(m_dialog_handle)) {
+                    CHATAPP_LOG(LogLevel::Warn, "failed to free GenieDialog");
+                }
+                m_dialog_handle = nullptr;
+            }
+        }
+
+        bool query(const std::string& prompt, const TokenCallback& callback) override {
+            CallbackWrapper wrapper{&callback};
+            return GENIE_STATUS_SUCCESS == GenieDialog_query(
+                                               m_dialog_handle,
+                                               prompt.c_str(),
+                                               GENIE_DIALOG_SENTENCE_COMPLETE,
+                                               trampoline,
+                                               &wrapper);
+        }
+
+        bool prefill(const std::string& prompt) override {
+            // A BEGIN query is a partial prompt: it is processed into the
+            // KV cache but no tokens are generated.
+            return GENIE_STATUS_SUCCESS == GenieDialog_query(
+                                               m_dialog_handle,
+                                               prompt.c_str(),
+                                               GENIE_DIALOG_SENTENCE_BEGIN,
+                                               trampoline,
+                                               nullptr);
+        }
+
+        std::shared_ptr<const DialogState> save_state() override {
+            const auto dir = next_state_dir();
+            std::error_code ec;
+            std::filesystem::create_directories(dir, ec);
+            if (ec || GENIE_STATUS_SUCCESS != GenieDialog_save(m_dialog_handle, dir.string().c_str())) {
+                std::filesystem::remove_all(dir, ec);
+                return nullptr;
+            }
+            return std::make_shared<GenieState>(dir);
+        }
+
+        bool restore_state(const DialogState& state) override {
+            const auto* genie_state = dynamic_cast<const GenieState*>(&state);
+            return genie_state &&
+                   GENIE_STATUS_SUCCESS ==
+                       GenieDialog_restore(m_dialog_handle, genie_state->dir().string().c_str());
+        }
+
+        bool set_sampling(const GenerationParams& params) override {
+            const float temperature = params.temperature.value_or(m_defaults.temperature);
+            const float top_p = params.top_p.value_or(m_defaults.top_p);
+            if (temperature == m_temperature && top_p == m_top_p) {
+                return true; // pooled dialog already configured this way
+            }
+
+            json sampler = {
+                {"sampler", {
+                    {"version", 1},
+                    {"temp", temperature},
+                    {"top-p", top_p},
+                    {"greedy", temperature == 0.0f}
+                }}
+            };
+            const std::string sampler_json = sampler.dump();
+
+            GenieSampler_Handle_t sampler_handle = nullptr;
+            GenieSamplerConfig_Handle_t sampler_config = nullptr;
+            if (GENIE_STATUS_SUCCESS != GenieDialog_getSampler(m_dialog_handle, &sampler_handle) ||
+                GENIE_STATUS_SUCCESS != GenieSamplerConfig_createFromJson(sampler_json.c_str(),
+                                                                          &sampler_config))
+            {
+                return false;
+            }
+            const bool ok = GENIE_STATUS_SUCCESS ==
+                            GenieSampler_applyConfig(sampler_handle, sampler_config);
+            GenieSamplerConfig_free(sampler_config);
+
+            if (ok) {
+                m_temperature = temperature;
+                m_top_p = top_p;
+            }
+            return ok;
+        }
+
+        bool reset() override {
+            return GENIE_STATUS_SUCCESS == GenieDialog_reset(m_dialog_handle);
+        }
+
+        bool abort() override {
+            return GENIE_STATUS_SUCCESS ==
+                   GenieDialog_signal(m_dialog_handle, GENIE_DIALOG_ACTION_ABORT);
+        }
+
+    private:
+        GenieDialog_Handle_t m_dialog_handle = nullptr;
+        GenieBackend::SamplerDefaults m_defaults;
+        float m_temperature; ///< Currently applied sampler values
+        float m_top_p;
+    };
+} // namespace
+
+// ---------------------------------------------------------------------
+// GenieBackend Implementation
+// ---------------------------------------------------------------------
+GenieBackend::GenieBackend(const std::string& config_json)
+{
+    if (GENIE_STATUS_SUCCESS !=
+        GenieDialogConfig_createFromJson(config_json.c_str(), &m_config_handle))
+    {
+        throw std::runtime_error("Failed to create Genie Dialog config.");
+    }
+
+    // Pick up the configured sampler so requests can fall back to it.
+    const json config = json::parse(config_json, nullptr, false);
+    if (config.is_object() && config.contains("dialog") &&
+        config["dialog"].contains("sampler"))
+    {
+        const json& sampler = config["dialog"]["sampler"];
+        m_sampler_defaults.temperature = sampler.value("temp", m_sampler_defaults.temperature);
+        m_sampler_defaults.top_p = sampler.value("top-p", m_sampler_defaults.top_p);
+    }
+}
+
+GenieBackend::~GenieBackend()
+{
+    if (m_config_handle != nullptr)
+    {
+        if (GENIE_STATUS_SUCCESS != GenieDialogConfig_free(m_config_handle)) {
+            CHATAPP_LOG(LogLevel::Warn, "failed to free GenieDialogConfig");
+        }
+        m_config_handle = nullptr;
+    }
+}
+
+std::unique_ptr<InferenceDialog> GenieBackend::create_dialog() {
+    return std::make_unique<GenieInferenceDialog>(m_config_handle, m_sampler_defaults);
+}
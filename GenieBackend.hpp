@@ -0,0 +1,34 @@
+// ---------------------------------------------------------------------
+// GenieBackend.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include "InferenceBackend.hpp"
+#include "GenieDialog.h"   // Genie SDK types
+#include "GenieSampler.h"
+
+// ---------------------------------------------------------------------
+// GenieBackend: runs dialogs on the NPU through the Genie SDK
+// ---------------------------------------------------------------------
+class GenieBackend : public InferenceBackend {
+public:
+    explicit GenieBackend(const std::string& config_json);
+    ~GenieBackend() override;
+
+    std::unique_ptr<InferenceDialog> create_dialog() override;
+    const char* name() const override { return "genie"; }
+
+    /// Sampler values from the dialog config, used when a request leaves
+    /// temperature/top_p unset.
+    struct SamplerDefaults {
+        float temperature = 0.8f;
+        float top_p = 0.95f;
+    };
+
+private:
+    GenieDialogConfig_Handle_t m_config_handle = nullptr;
+    SamplerDefaults m_sampler_defaults;
+};
@@ -0,0 +1,21 @@
+// ---------------------------------------------------------------------
+// Hash.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+constexpr uint64_t c_fnv1a_offset = 14695981039346656037ull;
+
+/// 64-bit FNV-1a; pass a previous result as `h` to hash incrementally.
+inline uint64_t fnv1a64(std::string_view s, uint64_t h = c_fnv1a_offset) {
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
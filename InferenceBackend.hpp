@@ -0,0 +1,97 @@
+// ---------------------------------------------------------------------
+// InferenceBackend.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <vector>
+
+// ---------------------------------------------------------------------
+// SentenceCode: backend-neutral mirror of GenieDialog_SentenceCode_t
+// ---------------------------------------------------------------------
+enum class SentenceCode {
+    Complete = 0, ///< Whole response delivered in one callback
+    Begin    = 1, ///< First chunk of a response
+    Continue = 2, ///< Intermediate chunk
+    End      = 3, ///< Last chunk (usually empty)
+    Abort    = 4, ///< Generation was aborted
+    Rewind   = 5,
+    Resume   = 6
+};
+
+// ---------------------------------------------------------------------
+// GenerationParams: per-request decoding controls
+// ---------------------------------------------------------------------
+struct GenerationParams {
+    size_t max_new_tokens = 0;            ///< 0 = until the model's end of turn
+    std::optional<float> temperature;     ///< Unset = backend config default; 0 = greedy
+    std::optional<float> top_p;           ///< Unset = backend config default
+    std::vector<std::string> stop;        ///< Generation ends before any of these
+    bool stop_at_json_end = false;        ///< End once the top-level JSON value closes
+};
+
+// ---------------------------------------------------------------------
+// DialogState: snapshot of a dialog's context (KV cache) for later restore
+// ---------------------------------------------------------------------
+class DialogState {
+public:
+    virtual ~DialogState() = default;
+
+    /// Bytes held by the snapshot; used for cache budgeting.
+    virtual size_t size_bytes() const = 0;
+};
+
+// ---------------------------------------------------------------------
+// InferenceDialog: one dialog handle owned by a backend
+// ---------------------------------------------------------------------
+class InferenceDialog {
+public:
+    using TokenCallback = std::function<void(const char*, SentenceCode)>;
+
+    /// Releases the underlying handle (GenieDialog_free for Genie).
+    virtual ~InferenceDialog() = default;
+
+    /// Prefill `prompt` and stream generated text through `callback`.
+    /// Returns false if the backend reported a failure.
+    virtual bool query(const std::string& prompt, const TokenCallback& callback) = 0;
+
+    /// Process `prompt` into the dialog context without generating.
+    virtual bool prefill(const std::string& prompt) = 0;
+
+    /// Snapshot the current context, or nullptr if unsupported/failed.
+    virtual std::shared_ptr<const DialogState> save_state() = 0;
+
+    /// Replace the current context with a snapshot from save_state()
+    /// of any dialog created by the same backend.
+    virtual bool restore_state(const DialogState& state) = 0;
+
+    /// Configure the sampler for the next query. Unset fields fall back to
+    /// the backend's configured defaults.
+    virtual bool set_sampling(const GenerationParams& params) = 0;
+
+    /// Drop all dialog state (KV cache, history).
+    virtual bool reset() = 0;
+
+    /// Request the in-flight query to stop. Safe to call from the
+    /// token callback or from another thread.
+    virtual bool abort() = 0;
+};
+
+// ---------------------------------------------------------------------
+// InferenceBackend: creates dialog handles for one loaded model
+// ---------------------------------------------------------------------
+class InferenceBackend {
+public:
+    virtual ~InferenceBackend() = default;
+
+    virtual std::unique_ptr<InferenceDialog> create_dialog() = 0;
+
+    /// Short identifier used in logs ("genie", "standin").
+    virtual const char* name() const = 0;
+};
@@ -0,0 +1,293 @@
+// ---------------------------------------------------------------------
+// InferenceQueue.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "InferenceQueue.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    constexpr double c_ewma_alpha = 0.2;
+    constexpr double c_bytes_per_token = 4.0; // rough BPE average for English
+
+    double ewma(double current, double sample) {
+        return current + c_ewma_alpha * (sample - current);
+    }
+} // namespace
+
+// ---------------------------------------------------------------------
+// InferenceQueue Implementation
+// ---------------------------------------------------------------------
+InferenceQueue::InferenceQueue(ChatManager& manager, const InferenceQueueConfig& config)
+    : m_manager(manager),
+      m_config(config),
+      m_decode_tok_per_s(config.initial_decode_tok_per_s),
+      m_tokens_per_job(config.initial_tokens_per_job),
+      m_prefill_tok_per_s(config.initial_prefill_tok_per_s)
+{
+    const size_t workers = std::max<size_t>(1, m_manager.pool_size());
+    for (size_t i = 0; i < workers; ++i) {
+        m_workers.emplace_back([this] { worker_loop(); });
+    }
+}
+
+InferenceQueue::~InferenceQueue()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        m_stopping = true;
+    }
+    m_work_cv.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+std::optional<InferenceQueue::Slot> InferenceQueue::try_admit() {
+    std::lock_guard<std::mutex> lk(m_mu);
+    if (m_jobs.size() + m_reserved >= m_config.max_depth) {
+        return std::nullopt;
+    }
+    ++m_reserved;
+    return Slot(this);
+}
+
+void InferenceQueue::release_slot() {
+    std::lock_guard<std::mutex> lk(m_mu);
+    --m_reserved;
+}
+
+InferenceQueue::PendingJob InferenceQueue::submit(Slot slot, InferenceJob job) {
+    auto state = std::make_shared<JobState>();
+    state->job = std::move(job);
+    state->enqueued = std::chrono::steady_clock::now();
+    state->trace_request = Tracer::current_request();
+
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        state->est_cost_s = estimate_cost_locked(state->job);
+        slot.m_queue = nullptr; // reservation becomes a queued job
+        --m_reserved;
+        m_jobs.push_back(state);
+    }
+    m_work_cv.notify_one();
+    return PendingJob(this, std::move(state));
+}
+
+GenerationResult InferenceQueue::run(Slot slot, InferenceJob job) {
+    return submit(std::move(slot), std::move(job)).wait();
+}
+
+bool InferenceQueue::expire_if_overdue_locked(JobState& state,
+                                              std::chrono::steady_clock::time_point now) {
+    if (state.status != JobStatus::Queued || now < state.enqueued + m_config.max_wait) {
+        return false;
+    }
+    // Still queued at the deadline: shed it.
+    m_jobs.erase(std::find_if(m_jobs.begin(), m_jobs.end(),
+                              [&](const auto& queued) { return queued.get() == &state; }));
+    state.status = JobStatus::Expired;
+    return true;
+}
+
+bool InferenceQueue::PendingJob::poll() {
+    std::lock_guard<std::mutex> lk(m_queue->m_mu);
+    m_queue->expire_if_overdue_locked(*m_state, std::chrono::steady_clock::now());
+    return m_state->status == JobStatus::Done || m_state->status == JobStatus::Expired;
+}
+
+bool InferenceQueue::PendingJob::expired() const {
+    std::lock_guard<std::mutex> lk(m_queue->m_mu);
+    return m_state->status == JobStatus::Expired;
+}
+
+GenerationResult InferenceQueue::PendingJob::wait() {
+    JobState& state = *m_state;
+    std::unique_lock<std::mutex> lk(m_queue->m_mu);
+
+    const auto deadline = state.enqueued + m_queue->m_config.max_wait;
+    m_queue->m_done_cv.wait_until(lk, deadline,
+                                  [&] { return state.status != JobStatus::Queued; });
+    m_queue->expire_if_overdue_locked(state, std::chrono::steady_clock::now());
+    if (state.status == JobStatus::Expired) {
+        throw QueueWaitTimeout();
+    }
+
+    m_queue->m_done_cv.wait(lk, [&] { return state.status == JobStatus::Done; });
+    if (state.error) {
+        std::rethrow_exception(state.error);
+    }
+    return state.job.result;
+}
+
+unsigned InferenceQueue::retry_after_seconds() const {
+    std::lock_guard<std::mutex> lk(m_mu);
+    const double queued = static_cast<double>(m_jobs.size() + m_reserved + 1);
+    const double rate = m_decode_tok_per_s * static_cast<double>(m_workers.size());
+    const double seconds = rate > 0.0 ? queued * m_tokens_per_job / rate : 1.0;
+    return static_cast<unsigned>(std::max(1.0, std::ceil(seconds)));
+}
+
+size_t InferenceQueue::depth() const {
+    std::lock_guard<std::mutex> lk(m_mu);
+    return m_jobs.size();
+}
+
+double InferenceQueue::decode_tok_per_s() const {
+    std::lock_guard<std::mutex> lk(m_mu);
+    return m_decode_tok_per_s;
+}
+
+double InferenceQueue::estimate_cost_locked(const InferenceJob& job) const {
+    const double prompt_tokens =
+        static_cast<double>(job.sys_prompt.size() + job.user_prompt.size()) / c_bytes_per_token;
+    const double new_tokens = job.params.max_new_tokens
+                                  ? static_cast<double>(job.params.max_new_tokens)
+                                  : m_tokens_per_job;
+    return prompt_tokens / m_prefill_tok_per_s + new_tokens / m_decode_tok_per_s;
+}
+
+std::shared_ptr<InferenceQueue::JobState> InferenceQueue::pop_next_locked() {
+    auto best = m_jobs.begin();
+    if (m_config.policy == SchedulingPolicy::ShortestJobFirst) {
+        // Aging changes the order over time, so scan instead of keeping a
+        // heap; the queue is bounded by max_depth.
+        const auto now = std::chrono::steady_clock::now();
+        double best_score = 0.0;
+        for (auto it = m_jobs.begin(); it != m_jobs.end(); ++it) {
+            const double waited =
+                std::chrono::duration<double>(now - (*it)->enqueued).count();
+            const double score = (*it)->est_cost_s - m_config.sjf_aging * waited;
+            if (it == m_jobs.begin() || score < best_score) {
+                best = it;
+                best_score = score;
+            }
+        }
+    }
+
+    auto state = std::move(*best);
+    m_jobs.erase(best);
+    return state;
+}
+
+void InferenceQueue::worker_loop() {
+    for (;;) {
+        std::shared_ptr<JobState> state;
+        {
+            std::unique_lock<std::mutex> lk(m_mu);
+            m_work_cv.wait(lk, [this] { return m_stopping || !m_jobs.empty(); });
+            if (m_stopping) return;
+
+            state = pop_next_locked();
+            state->status = JobStatus::Running;
+        }
+        m_done_cv.notify_all();
+
+        if (state->job.on_start) {
+            try {
+                state->job.on_start();
+            } catch (...) {
+                // Start hooks must not take the worker down either.
+            }
+        }
+        execute(*state);
+
+        {
+            std::lock_guard<std::mutex> lk(m_mu);
+            state->status = JobStatus::Done;
+        }
+        m_done_cv.notify_all();
+
+        if (state->job.on_complete) {
+            try {
+                state->job.on_complete(state->job.result, state->error);
+            } catch (...) {
+                // Completion hooks must not take the worker down.
+            }
+        }
+        // Release what the hooks captured now, not with the last PendingJob.
+        state->job.callback = nullptr;
+        state->job.on_start = nullptr;
+        state->job.on_complete = nullptr;
+    }
+}
+
+void InferenceQueue::execute(JobState& state) {
+    using clock = std::chrono::steady_clock;
+
+    size_t tokens = 0;
+    const clock::time_point start = clock::now();
+    clock::time_point first_token;
+    clock::time_point last_token;
+
+    if (m_metrics) {
+        m_metrics->queue_wait_seconds.observe(std::chrono::duration<double>(start - state.enqueued).count());
+    }
+    const TraceScope trace(state.trace_request);
+    if (state.trace_request) {
+        Tracer::instance().record("queue_wait", state.trace_request, state.enqueued, start);
+    }
+
+    if (state.job.cancel && state.job.cancel->load(std::memory_order_relaxed)) {
+        // Its client left while it was queued: skip the prefill altogether.
+        state.job.result.finish_reason = FinishReason::Aborted;
+        return;
+    }
+
+    try {
+        auto dlg = m_manager.acquire_pooled_dialogue();
+        state.job.result = m_manager.query(
+            dlg.id(), state.job.sys_prompt, state.job.user_prompt,
+            [&](const char* text, SentenceCode code) {
+                if (text && *text) {
+                    const clock::time_point now = clock::now();
+                    if (tokens++ == 0) {
+                        first_token = now;
+                    } else if (m_metrics) {
+                        m_metrics->inter_token_seconds.observe(
+                            std::chrono::duration<double>(now - last_token).count());
+                    }
+                    last_token = now;
+                }
+                if (state.job.callback) state.job.callback(text, code);
+            },
+            state.job.params,
+            state.job.cancel);
+    } catch (...) {
+        state.error = std::current_exception();
+    }
+
+    if (tokens > 0 && m_metrics) {
+        m_metrics->ttft_seconds.observe(std::chrono::duration<double>(first_token - state.enqueued).count());
+    }
+    if (tokens > 1) {
+        record_generation(state.job.result.prefilled_bytes,
+                          std::chrono::duration<double>(first_token - start).count(),
+                          tokens,
+                          std::chrono::duration<double>(last_token - first_token).count());
+    }
+}
+
+void InferenceQueue::record_generation(size_t prefilled_bytes, double prefill_seconds,
+                                       size_t tokens, double decode_seconds) {
+    const double prompt_tokens = static_cast<double>(prefilled_bytes) / c_bytes_per_token;
+    const double prefill_rate = prefill_seconds > 0.0 ? prompt_tokens / prefill_seconds : 0.0;
+    const double decode_rate = decode_seconds > 0.0 ? static_cast<double>(tokens - 1) / decode_seconds : 0.0;
+    if (m_metrics) {
+        if (prefill_rate > 0.0) m_metrics->prefill_tok_per_s.observe(prefill_rate);
+        if (decode_rate > 0.0) m_metrics->decode_tok_per_s.observe(decode_rate);
+    }
+
+    std::lock_guard<std::mutex> lk(m_mu);
+    if (prefill_rate > 0.0) {
+        m_prefill_tok_per_s = ewma(m_prefill_tok_per_s, prefill_rate);
+    }
+    if (decode_rate > 0.0) {
+        m_decode_tok_per_s = ewma(m_decode_tok_per_s, decode_rate);
+    }
+    m_tokens_per_job = ewma(m_tokens_per_job, static_cast<double>(tokens));
+}
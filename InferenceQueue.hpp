@@ -0,0 +1,186 @@
+// ---------------------------------------------------------------------
+// InferenceQueue.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ChatManager.hpp"
+
+// ---------------------------------------------------------------------
+// InferenceJob: one stateless query to run on a pooled dialogue
+// ---------------------------------------------------------------------
+struct InferenceJob {
+    std::string sys_prompt;
+    std::string user_prompt;
+    ChatManager::ResponseCallback callback;
+    GenerationParams params;
+    const std::atomic<bool>* cancel = nullptr; ///< See ChatManager::query
+    GenerationResult result;  ///< Filled in by the worker once the job has run
+
+    /// Optional: called on the worker thread just before the job starts.
+    /// If it sets `*cancel` the job is skipped and finishes as Aborted.
+    std::function<void()> on_start;
+
+    /// Optional: called on the worker thread once the job has run, for
+    /// callers that submit() without waiting. `error` is set if the query threw.
+    std::function<void(const GenerationResult& result, std::exception_ptr error)> on_complete;
+};
+
+/// Order in which queued jobs are handed to workers.
+enum class SchedulingPolicy {
+    Fifo,             ///< Arrival order
+    ShortestJobFirst  ///< Lowest estimated cost first, with aging
+};
+
+// ---------------------------------------------------------------------
+// InferenceQueueConfig
+// ---------------------------------------------------------------------
+struct InferenceQueueConfig {
+    size_t max_depth = 16;                           ///< Jobs allowed to wait (not counting running ones)
+    std::chrono::milliseconds max_wait{10000};       ///< Longest a job may wait before run()/PendingJob sheds it
+    double initial_decode_tok_per_s = 12.0;          ///< Seed for the decode rate estimate
+    double initial_tokens_per_job = 64.0;            ///< Seed for the output length estimate
+    double initial_prefill_tok_per_s = 300.0;        ///< Seed for the prefill rate estimate
+    SchedulingPolicy policy = SchedulingPolicy::Fifo;
+    double sjf_aging = 2.0;                          ///< Seconds of cost forgiven per second waited
+};
+
+/// Thrown by InferenceQueue::run() when a job waited longer than max_wait.
+class QueueWaitTimeout : public std::runtime_error {
+public:
+    QueueWaitTimeout() : std::runtime_error("Timed out waiting in inference queue") {}
+};
+
+// ---------------------------------------------------------------------
+// InferenceQueue: bounded queue in front of ChatManager::query
+// ---------------------------------------------------------------------
+/// One worker thread per pooled dialogue pulls jobs in the order given
+/// by the scheduling policy. Under ShortestJobFirst a job's estimated
+/// cost (prefill of the prompt + decode of max_new_tokens at the measured
+/// rates) shrinks by sjf_aging for every second it waits, so long
+/// generations cannot be starved by a stream of short classifier calls.
+/// Callers first take an admission Slot (fails fast when the queue is
+/// full) and then either block in run() until their job has finished, or
+/// submit() it and poll the returned PendingJob while doing other work.
+class InferenceQueue {
+    struct JobState;
+
+public:
+    /// Admission reservation; counts against max_depth until it is run or dropped.
+    class Slot {
+    public:
+        explicit Slot(InferenceQueue* queue) : m_queue(queue) {}
+        Slot(Slot&& other) noexcept : m_queue(other.m_queue) { other.m_queue = nullptr; }
+        Slot(const Slot&) = delete;
+        Slot& operator=(const Slot&) = delete;
+        Slot& operator=(Slot&&) = delete;
+        ~Slot() { if (m_queue) m_queue->release_slot(); }
+
+    private:
+        friend class InferenceQueue;
+        InferenceQueue* m_queue;
+    };
+
+    /// A submitted job. Whatever the job's callback references must stay
+    /// alive until poll() has returned true or wait() has returned.
+    class PendingJob {
+    public:
+        /// Non-blocking: true once the job has finished or was shed.
+        bool poll();
+
+        /// The job was shed for waiting longer than max_wait. Only
+        /// meaningful once poll() has returned true.
+        bool expired() const;
+
+        /// Block until the job has run. Rethrows errors from
+        /// ChatManager::query; throws QueueWaitTimeout if it was shed.
+        GenerationResult wait();
+
+    private:
+        friend class InferenceQueue;
+        PendingJob(InferenceQueue* queue, std::shared_ptr<JobState> state)
+            : m_queue(queue), m_state(std::move(state)) {}
+
+        InferenceQueue* m_queue;
+        std::shared_ptr<JobState> m_state;
+    };
+
+    InferenceQueue(ChatManager& manager, const InferenceQueueConfig& config);
+    ~InferenceQueue();
+
+    /// Reserve a place in the queue, or nullopt if it is full.
+    std::optional<Slot> try_admit();
+
+    /// Enqueue `job` and return at once.
+    PendingJob submit(Slot slot, InferenceJob job);
+
+    /// Enqueue `job` and block until it has run; submit(...).wait().
+    GenerationResult run(Slot slot, InferenceJob job);
+
+    /// Seconds a rejected client should back off: queued work divided by
+    /// the measured decode rate across all workers.
+    unsigned retry_after_seconds() const;
+
+    size_t depth() const;
+    double decode_tok_per_s() const;
+
+    /// Record queue wait, time to first token, inter-token latency and
+    /// per-generation rates into `metrics`, which must outlive the queue.
+    /// Call before submitting jobs.
+    void set_metrics(ServerMetrics* metrics) { m_metrics = metrics; }
+
+private:
+    enum class JobStatus { Queued, Running, Done, Expired };
+
+    struct JobState {
+        InferenceJob job;
+        std::chrono::steady_clock::time_point enqueued;
+        double est_cost_s = 0.0;
+        uint64_t trace_request = 0;  ///< Submitter's sampled request, traced on the worker
+        JobStatus status = JobStatus::Queued;
+        std::exception_ptr error;
+    };
+
+    /// Shed the job if it is still queued at its deadline. Requires m_mu.
+    bool expire_if_overdue_locked(JobState& state, std::chrono::steady_clock::time_point now);
+
+    double estimate_cost_locked(const InferenceJob& job) const;
+    std::shared_ptr<JobState> pop_next_locked();
+    void worker_loop();
+    void execute(JobState& state);
+    void release_slot();
+    void record_generation(size_t prefilled_bytes, double prefill_seconds,
+                           size_t tokens, double decode_seconds);
+
+    ChatManager& m_manager;
+    InferenceQueueConfig m_config;
+    ServerMetrics* m_metrics = nullptr;
+
+    mutable std::mutex m_mu;
+    std::condition_variable m_work_cv;  ///< Signals workers: job queued or shutdown
+    std::condition_variable m_done_cv;  ///< Signals callers: a job changed status
+    std::deque<std::shared_ptr<JobState>> m_jobs;
+    size_t m_reserved = 0;              ///< Admitted slots not yet enqueued
+    bool m_stopping = false;
+
+    double m_decode_tok_per_s;          ///< EWMA, guarded by m_mu
+    double m_tokens_per_job;            ///< EWMA, guarded by m_mu
+    double m_prefill_tok_per_s;         ///< EWMA, guarded by m_mu
+
+    std::vector<std::thread> m_workers;
+};
@@ -0,0 +1,264 @@
+// ---------------------------------------------------------------------
+// JobStore.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "JobStore.hpp"
+#include <cstdio>
+
+namespace {
+    /// Retry interval for feeding the backlog when the queue was full.
+    constexpr std::chrono::milliseconds c_dispatch_interval{50};
+} // namespace
+
+const char* to_string(AsyncJobStatus status) {
+    switch (status) {
+        case AsyncJobStatus::Queued:    return "queued";
+        case AsyncJobStatus::Running:   return "running";
+        case AsyncJobStatus::Done:      return "done";
+        case AsyncJobStatus::Cancelled: return "cancelled";
+        case AsyncJobStatus::Failed:    return "failed";
+    }
+    return "unknown";
+}
+
+// ---------------------------------------------------------------------
+// JobStore Implementation
+// ---------------------------------------------------------------------
+JobStore::JobStore(InferenceQueue& queue, ResponseCache* cache, const JobStoreConfig& config)
+    : m_queue(queue),
+      m_cache(cache),
+      m_config(config),
+      m_id_rng(std::random_device{}())
+{
+    m_dispatcher = std::thread([this] { dispatcher_loop(); });
+}
+
+JobStore::~JobStore()
+{
+    {
+        std::unique_lock<std::mutex> lk(m_mu);
+        m_stopping = true;
+        // Jobs in the queue call back into us; abort them and wait.
+        for (auto& [id, job] : m_jobs) {
+            job->cancel.store(true, std::memory_order_relaxed);
+        }
+        m_cv.wait(lk, [this] { return m_in_queue == 0; });
+    }
+    m_cv.notify_all();
+    m_dispatcher.join();
+}
+
+std::optional<std::string> JobStore::submit(std::string sys_prompt, std::string user_prompt,
+                                            GenerationParams params,
+                                            std::optional<RequestKey> cache_key)
+{
+    auto job = std::make_shared<Job>();
+    job->sys_prompt = std::move(sys_prompt);
+    job->user_prompt = std::move(user_prompt);
+    job->params = std::move(params);
+    job->cache_key = cache_key;
+
+    std::shared_ptr<const ResponseCache::Entry> hit;
+    if (m_cache && cache_key) {
+        hit = m_cache->lookup(*cache_key);
+    }
+
+    std::lock_guard<std::mutex> lk(m_mu);
+    if (!hit && m_unfinished >= m_config.max_backlog) {
+        return std::nullopt;
+    }
+
+    char id[24];
+    do {
+        std::snprintf(id, sizeof(id), "job_%016llx", static_cast<unsigned long long>(m_id_rng()));
+    } while (m_jobs.count(id));
+    job->id = id;
+    m_jobs.emplace(job->id, job);
+
+    if (hit) {
+        job->status = AsyncJobStatus::Done;
+        job->output = hit->text();
+        job->result = hit->result();
+        job->finished_at = std::chrono::steady_clock::now();
+        m_finished.push_back(job);
+        return job->id;
+    }
+
+    ++m_unfinished;
+    m_backlog.push_back(job);
+    dispatch_locked();
+    return job->id;
+}
+
+void JobStore::dispatch_locked() {
+    while (!m_backlog.empty()) {
+        auto job = m_backlog.front();
+        if (job->cancel.load(std::memory_order_relaxed)) {
+            m_backlog.pop_front();
+            {
+                std::lock_guard<std::mutex> job_lk(job->mu);
+                job->status = AsyncJobStatus::Cancelled;
+                job->result.finish_reason = FinishReason::Aborted;
+                job->finished_at = std::chrono::steady_clock::now();
+            }
+            job->cv.notify_all();
+            --m_unfinished;
+            m_finished.push_back(job);
+            continue;
+        }
+
+        if (m_in_queue >= m_config.max_in_queue) {
+            return; // finish() wakes the dispatcher as jobs complete
+        }
+        auto slot = m_queue.try_admit();
+        if (!slot) {
+            return; // the dispatcher retries shortly
+        }
+        m_backlog.pop_front();
+        ++m_in_queue;
+        start(job, std::move(*slot));
+    }
+}
+
+void JobStore::start(const std::shared_ptr<Job>& job, InferenceQueue::Slot slot) {
+    InferenceJob work;
+    work.sys_prompt = job->sys_prompt;
+    work.user_prompt = job->user_prompt;
+    work.params = job->params;
+    work.cancel = &job->cancel;
+    work.on_start = [job] {
+        {
+            std::lock_guard<std::mutex> lk(job->mu);
+            job->status = AsyncJobStatus::Running;
+        }
+        job->cv.notify_all();
+    };
+    work.callback = [job, record = m_cache && job->cache_key](const char* text, SentenceCode) {
+        if (record) job->recorder.record(text);
+        {
+            std::lock_guard<std::mutex> lk(job->mu);
+            job->output += text;
+        }
+        job->cv.notify_all();
+    };
+    work.on_complete = [this, job](const GenerationResult& result, std::exception_ptr error) {
+        finish(job, result, error);
+    };
+
+    // Nobody waits on the PendingJob; on_complete reports the outcome.
+    m_queue.submit(std::move(slot), std::move(work));
+}
+
+void JobStore::finish(const std::shared_ptr<Job>& job, const GenerationResult& result,
+                      std::exception_ptr error)
+{
+    AsyncJobStatus status = AsyncJobStatus::Done;
+    std::string message;
+    if (error) {
+        status = AsyncJobStatus::Failed;
+        try {
+            std::rethrow_exception(error);
+        } catch (const std::exception& e) {
+            message = e.what();
+        } catch (...) {
+            message = "unknown error";
+        }
+    } else if (result.finish_reason == FinishReason::Aborted) {
+        status = AsyncJobStatus::Cancelled;
+    }
+
+    if (status == AsyncJobStatus::Done && m_cache && job->cache_key) {
+        m_cache->insert(*job->cache_key, job->recorder.finish(result));
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(job->mu);
+        job->status = status;
+        job->result = result;
+        job->error = std::move(message);
+        job->finished_at = std::chrono::steady_clock::now();
+    }
+    job->cv.notify_all();
+
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        --m_unfinished;
+        --m_in_queue;
+        m_finished.push_back(job);
+    }
+    m_cv.notify_all(); // a slot freed up; also releases the destructor
+}
+
+void JobStore::dispatcher_loop() {
+    std::unique_lock<std::mutex> lk(m_mu);
+    while (!m_stopping) {
+        m_cv.wait_for(lk, c_dispatch_interval);
+        if (m_stopping) break;
+
+        dispatch_locked();
+
+        const auto now = std::chrono::steady_clock::now();
+        while (!m_finished.empty() && now - m_finished.front()->finished_at >= m_config.ttl) {
+            m_jobs.erase(m_finished.front()->id);
+            m_finished.pop_front();
+        }
+    }
+}
+
+std::shared_ptr<JobStore::Job> JobStore::find(const std::string& id) const {
+    std::lock_guard<std::mutex> lk(m_mu);
+    auto it = m_jobs.find(id);
+    return it == m_jobs.end() ? nullptr : it->second;
+}
+
+JobStore::Snapshot JobStore::snapshot_locked(const Job& job, size_t offset) const {
+    Snapshot s;
+    s.id = job.id;
+    s.status = job.status;
+    s.output_size = job.output.size();
+    if (offset < job.output.size()) {
+        s.output = job.output.substr(offset);
+    }
+    s.result = job.result;
+    s.error = job.error;
+    return s;
+}
+
+std::optional<JobStore::Snapshot> JobStore::wait(const std::string& id, size_t offset,
+                                                 std::chrono::milliseconds timeout)
+{
+    auto job = find(id);
+    if (!job) return std::nullopt;
+
+    std::unique_lock<std::mutex> lk(job->mu);
+    job->cv.wait_for(lk, timeout, [&] {
+        return job->output.size() > offset || job->status >= AsyncJobStatus::Done;
+    });
+    return snapshot_locked(*job, offset);
+}
+
+std::optional<JobStore::Snapshot> JobStore::wait_finished(const std::string& id,
+                                                          std::chrono::milliseconds timeout)
+{
+    auto job = find(id);
+    if (!job) return std::nullopt;
+
+    std::unique_lock<std::mutex> lk(job->mu);
+    job->cv.wait_for(lk, timeout, [&] { return job->status >= AsyncJobStatus::Done; });
+    return snapshot_locked(*job, 0);
+}
+
+bool JobStore::cancel(const std::string& id) {
+    auto job = find(id);
+    if (!job) return false;
+    job->cancel.store(true, std::memory_order_relaxed);
+    m_cv.notify_all(); // backlog entries are retired by the dispatcher
+    return true;
+}
+
+size_t JobStore::backlog() const {
+    std::lock_guard<std::mutex> lk(m_mu);
+    return m_backlog.size();
+}
@@ -0,0 +1,126 @@
+// ---------------------------------------------------------------------
+// JobStore.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "InferenceQueue.hpp"
+#include "ResponseCache.hpp"
+
+enum class AsyncJobStatus {
+    Queued,    ///< Waiting for a queue slot or a dialog
+    Running,   ///< Producing output
+    Done,
+    Cancelled,
+    Failed
+};
+
+const char* to_string(AsyncJobStatus status);
+
+struct JobStoreConfig {
+    size_t max_backlog = 1024;          ///< Jobs accepted but not yet finished
+    std::chrono::seconds ttl{600};      ///< How long finished results are kept
+    size_t max_in_queue = 4;            ///< Jobs holding InferenceQueue slots at once
+};
+
+// ---------------------------------------------------------------------
+// JobStore: fire-and-forget generations behind POST /jobs
+// ---------------------------------------------------------------------
+/// Accepted jobs wait in a backlog and are fed into the InferenceQueue
+/// as it has room, so a pending job costs memory rather than an HTTP
+/// thread. At most max_in_queue of them hold a queue slot at a time, so
+/// the backlog runs as a background lane and leaves the rest of the queue
+/// to interactive requests. Finished jobs are kept for `ttl` and then forgotten. A single
+/// dispatcher thread moves backlog into the queue and expires results.
+class JobStore {
+public:
+    /// Point-in-time view of a job.
+    struct Snapshot {
+        std::string id;
+        AsyncJobStatus status = AsyncJobStatus::Queued;
+        std::string output;         ///< Whole output, or from the requested offset
+        size_t output_size = 0;     ///< Total bytes produced so far
+        GenerationResult result;    ///< Valid once finished
+        std::string error;          ///< Set when Failed
+        bool finished() const { return status >= AsyncJobStatus::Done; }
+    };
+
+    JobStore(InferenceQueue& queue, ResponseCache* cache, const JobStoreConfig& config);
+    ~JobStore();
+
+    /// Accept a job; returns its id, or nullopt if the backlog is full.
+    /// With `cache_key` set the response cache is consulted first and
+    /// filled afterwards.
+    std::optional<std::string> submit(std::string sys_prompt, std::string user_prompt,
+                                      GenerationParams params,
+                                      std::optional<RequestKey> cache_key);
+
+    /// Block until the job has produced more than `offset` bytes or
+    /// finished, or `timeout` passes; returns output past `offset`.
+    /// nullopt for unknown or expired ids.
+    std::optional<Snapshot> wait(const std::string& id, size_t offset,
+                                 std::chrono::milliseconds timeout);
+
+    /// Block until the job has finished or `timeout` passes.
+    std::optional<Snapshot> wait_finished(const std::string& id, std::chrono::milliseconds timeout);
+
+    /// Abort a queued or running job. False for unknown ids.
+    bool cancel(const std::string& id);
+
+    size_t backlog() const;
+
+private:
+    struct Job {
+        std::string id;
+        std::string sys_prompt;
+        std::string user_prompt;
+        GenerationParams params;
+        std::optional<RequestKey> cache_key;
+        std::atomic<bool> cancel{false};
+        ResponseCache::Recorder recorder;   ///< Inference thread only
+
+        mutable std::mutex mu;
+        std::condition_variable cv;
+        AsyncJobStatus status = AsyncJobStatus::Queued;
+        std::string output;
+        GenerationResult result;
+        std::string error;
+        std::chrono::steady_clock::time_point finished_at;
+    };
+
+    std::shared_ptr<Job> find(const std::string& id) const;
+    Snapshot snapshot_locked(const Job& job, size_t offset) const;
+    void dispatch_locked();
+    void start(const std::shared_ptr<Job>& job, InferenceQueue::Slot slot);
+    void finish(const std::shared_ptr<Job>& job, const GenerationResult& result, std::exception_ptr error);
+    void dispatcher_loop();
+
+    InferenceQueue& m_queue;
+    ResponseCache* m_cache;
+    JobStoreConfig m_config;
+
+    mutable std::mutex m_mu;
+    std::condition_variable m_cv;        ///< Wakes the dispatcher
+    std::unordered_map<std::string, std::shared_ptr<Job>> m_jobs;
+    std::deque<std::shared_ptr<Job>> m_backlog;               ///< Not yet in the queue
+    std::deque<std::shared_ptr<Job>> m_finished;              ///< In finish order, for TTL expiry
+    size_t m_unfinished = 0;
+    size_t m_in_queue = 0;               ///< Handed to the queue, not yet finished
+    std::mt19937_64 m_id_rng;            ///< Job ids are unguessable; guarded by m_mu
+    bool m_stopping = false;
+
+    std::thread m_dispatcher;
+};
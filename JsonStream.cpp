@@ -0,0 +1,311 @@
+// ---------------------------------------------------------------------
+// JsonStream.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "JsonStream.hpp"
+#include <stdexcept>
+
+// ---------------------------------------------------------------------
+// JsonObjectTracker Implementation
+// ---------------------------------------------------------------------
+size_t JsonObjectTracker::feed(std::string_view chunk) {
+    if (m_complete) return npos;
+
+    for (size_t i = 0; i < chunk.size(); ++i) {
+        const char c = chunk[i];
+
+        if (m_in_string) {
+            if (m_escape) {
+                m_escape = false;       // \uXXXX digits need no special care
+            } else if (c == '\\') {
+                m_escape = true;
+            } else if (c == '"') {
+                m_in_string = false;
+            }
+            continue;
+        }
+
+        switch (c) {
+            case '"':
+                if (m_depth > 0) m_in_string = true;
+                break;
+            case '{':
+            case '[':
+                ++m_depth;
+                break;
+            case '}':
+            case ']':
+                if (m_depth > 0 && --m_depth == 0) {
+                    m_complete = true;
+                    return i + 1;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return npos;
+}
+
+// ---------------------------------------------------------------------
+// JsonFieldExtractor Implementation
+// ---------------------------------------------------------------------
+namespace {
+    size_t encode_utf8(uint32_t cp, char out[4]) {
+        if (cp < 0x80) {
+            out[0] = static_cast<char>(cp);
+            return 1;
+        }
+        if (cp < 0x800) {
+            out[0] = static_cast<char>(0xC0 | (cp >> 6));
+            out[1] = static_cast<char>(0x80 | (cp & 0x3F));
+            return 2;
+        }
+        if (cp < 0x10000) {
+            out[0] = static_cast<char>(0xE0 | (cp >> 12));
+            out[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out[2] = static_cast<char>(0x80 | (cp & 0x3F));
+            return 3;
+        }
+        out[0] = static_cast<char>(0xF0 | (cp >> 18));
+        out[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out[3] = static_cast<char>(0x80 | (cp & 0x3F));
+        return 4;
+    }
+
+    int hex_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    constexpr uint32_t c_replacement_char = 0xFFFD;
+} // namespace
+
+JsonFieldExtractor::JsonFieldExtractor(std::vector<std::string> keys)
+    : m_keys(std::move(keys))
+{
+    if (m_keys.empty() || m_keys.size() > c_max_keys) {
+        throw std::invalid_argument("extract must list between 1 and 64 keys");
+    }
+}
+
+void JsonFieldExtractor::push(bool is_object) {
+    if (m_depth < 64) {
+        const uint64_t bit = uint64_t{1} << m_depth;
+        m_object_bits = is_object ? (m_object_bits | bit) : (m_object_bits & ~bit);
+    }
+    ++m_depth;
+}
+
+void JsonFieldExtractor::pop() {
+    if (m_depth > 0) --m_depth;
+}
+
+bool JsonFieldExtractor::in_object() const {
+    // Levels past 64 are treated as arrays, so nothing deeper is extracted.
+    return m_depth > 0 && m_depth <= 64 && (m_object_bits >> (m_depth - 1)) & 1;
+}
+
+void JsonFieldExtractor::match_key_byte(char c) {
+    for (size_t i = 0; i < m_keys.size(); ++i) {
+        if (((m_candidates >> i) & 1) &&
+            (m_key_pos >= m_keys[i].size() || m_keys[i][m_key_pos] != c)) {
+            m_candidates &= ~(uint64_t{1} << i);
+        }
+    }
+    ++m_key_pos;
+}
+
+size_t JsonFieldExtractor::decode_escape(char c, char* out) {
+    if (m_hex_digits >= 0) {
+        const int v = hex_value(c);
+        if (v < 0) {
+            m_hex_digits = -1;
+            m_high_surrogate = 0;
+            return encode_utf8(c_replacement_char, out);
+        }
+        m_code_unit = (m_code_unit << 4) | static_cast<uint32_t>(v);
+        if (++m_hex_digits < 4) return 0;
+
+        m_hex_digits = -1;
+        const uint32_t unit = m_code_unit;
+        if (unit >= 0xD800 && unit <= 0xDBFF) {
+            // High surrogate: wait for the low half in the next \uXXXX
+            const bool orphan = m_high_surrogate != 0;
+            m_high_surrogate = unit;
+            return orphan ? encode_utf8(c_replacement_char, out) : 0;
+        }
+        if (unit >= 0xDC00 && unit <= 0xDFFF) {
+            if (!m_high_surrogate) return encode_utf8(c_replacement_char, out);
+            const uint32_t cp = 0x10000 + ((m_high_surrogate - 0xD800) << 10) + (unit - 0xDC00);
+            m_high_surrogate = 0;
+            return encode_utf8(cp, out);
+        }
+        size_t n = 0;
+        if (m_high_surrogate) {
+            m_high_surrogate = 0;
+            n = encode_utf8(c_replacement_char, out);
+        }
+        return n + encode_utf8(unit, out + n);
+    }
+
+    m_escape = false;
+    if (c == 'u') {
+        m_hex_digits = 0;
+        m_code_unit = 0;
+        return 0;
+    }
+
+    size_t n = 0;
+    if (m_high_surrogate) {
+        // \uD83D followed by a non-\u escape: drop the orphan half
+        m_high_surrogate = 0;
+        n = encode_utf8(c_replacement_char, out);
+    }
+    switch (c) {
+        case 'n': out[n] = '\n'; break;
+        case 't': out[n] = '\t'; break;
+        case 'r': out[n] = '\r'; break;
+        case 'b': out[n] = '\b'; break;
+        case 'f': out[n] = '\f'; break;
+        default:  out[n] = c;    break; // \" \\ \/ and anything unexpected
+    }
+    return n + 1;
+}
+
+void JsonFieldExtractor::feed(std::string_view chunk, Listener& listener) {
+    size_t run_start = 0; // start of the unescaped run in State::Value
+    char decoded[8];
+
+    auto flush_run = [&](size_t end) {
+        if (end > run_start) {
+            listener.on_field_text(m_value_key, chunk.substr(run_start, end - run_start));
+        }
+    };
+
+    for (size_t i = 0; i < chunk.size(); ++i) {
+        const char c = chunk[i];
+
+        switch (m_state) {
+        case State::Value:
+        case State::Key:
+        case State::Skip: {
+            const bool escaped = m_escape || m_hex_digits >= 0;
+            if (!escaped && c == '\\') {
+                if (m_state == State::Value) {
+                    flush_run(i);
+                    run_start = i + 1;
+                }
+                m_escape = true;
+                continue;
+            }
+            if (escaped) {
+                // Surrogate halves are buffered, so a \uXXXX may yield
+                // a replacement char plus a code point (up to 7 bytes).
+                const size_t n = decode_escape(c, decoded);
+                if (m_state == State::Value) {
+                    if (n) listener.on_field_text(m_value_key, std::string_view(decoded, n));
+                    run_start = i + 1;
+                } else if (m_state == State::Key) {
+                    for (size_t k = 0; k < n; ++k) match_key_byte(decoded[k]);
+                }
+                continue;
+            }
+            if (m_high_surrogate) {
+                // High surrogate not followed by a \uDC00-\uDFFF escape
+                const size_t n = encode_utf8(c_replacement_char, decoded);
+                m_high_surrogate = 0;
+                if (m_state == State::Value) {
+                    flush_run(i);
+                    run_start = i;
+                    listener.on_field_text(m_value_key, std::string_view(decoded, n));
+                } else if (m_state == State::Key) {
+                    for (size_t k = 0; k < n; ++k) match_key_byte(decoded[k]);
+                }
+            }
+            if (c != '"') {
+                if (m_state == State::Key) match_key_byte(c);
+                continue;
+            }
+
+            // Closing quote
+            if (m_state == State::Value) {
+                flush_run(i);
+                listener.on_field_end(m_value_key);
+                m_value_key = npos;
+            } else if (m_state == State::Key) {
+                m_pending_key = npos;
+                for (size_t k = 0; k < m_keys.size(); ++k) {
+                    if (((m_candidates >> k) & 1) && m_keys[k].size() == m_key_pos) {
+                        m_pending_key = k;
+                        break;
+                    }
+                }
+            }
+            m_state = State::Structure;
+            break;
+        }
+
+        case State::Structure:
+            switch (c) {
+                case '"':
+                    if (m_expect_key) {
+                        m_state = State::Key;
+                        m_candidates = m_keys.size() == c_max_keys ? ~uint64_t{0}
+                                                           : (uint64_t{1} << m_keys.size()) - 1;
+                        m_key_pos = 0;
+                        m_expect_key = false;
+                    } else if (m_pending_key != npos) {
+                        m_state = State::Value;
+                        m_value_key = m_pending_key;
+                        m_pending_key = npos;
+                        run_start = i + 1;
+                    } else {
+                        m_state = State::Skip;
+                    }
+                    break;
+                case '{':
+                    push(true);
+                    m_expect_key = true;
+                    m_pending_key = npos;
+                    break;
+                case '[':
+                    push(false);
+                    m_expect_key = false;
+                    m_pending_key = npos;
+                    break;
+                case '}':
+                case ']':
+                    pop();
+                    m_expect_key = false;
+                    m_pending_key = npos;
+                    break;
+                case ',':
+                    m_expect_key = in_object();
+                    m_pending_key = npos;
+                    break;
+                case ':':
+                    m_expect_key = false;
+                    break;
+                case ' ':
+                case '\t':
+                case '\n':
+                case '\r':
+                    break;
+                default:
+                    m_pending_key = npos; // number, literal: not a string value
+                    break;
+            }
+            break;
+        }
+    }
+
+    if (m_state == State::Value) {
+        flush_run(chunk.size());
+    }
+}
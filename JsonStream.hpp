@@ -0,0 +1,107 @@
+// ---------------------------------------------------------------------
+// JsonStream.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ---------------------------------------------------------------------
+// JsonObjectTracker: detects when streamed model output closes its JSON
+// ---------------------------------------------------------------------
+/// Tracks object/array nesting plus string and escape state across
+/// arbitrary chunk boundaries. Text before the first '{' or '[' is
+/// ignored; once nesting returns to zero the top-level value is complete.
+class JsonObjectTracker {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    /// Consume `chunk`. Returns the number of bytes of `chunk` up to and
+    /// including the closing bracket if the top-level value completed in
+    /// this chunk, otherwise npos.
+    size_t feed(std::string_view chunk);
+
+    bool complete() const { return m_complete; }
+
+private:
+    size_t m_depth = 0;
+    bool m_in_string = false;
+    bool m_escape = false;
+    bool m_complete = false;
+};
+
+// ---------------------------------------------------------------------
+// JsonFieldExtractor: streams decoded string values of selected keys
+// ---------------------------------------------------------------------
+/// Incremental tokenizer over streamed model output. Whenever an object
+/// member whose key is in the extract list has a string value, the
+/// decoded value (escapes and \uXXXX, including surrogate pairs, turned
+/// into UTF-8) is passed to the listener piece by piece as it arrives.
+/// Keys match at any nesting depth. feed() never allocates: unescaped
+/// runs are handed out as views into the input chunk.
+class JsonFieldExtractor {
+public:
+    static constexpr size_t c_max_keys = 64;
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    class Listener {
+    public:
+        virtual ~Listener() = default;
+
+        /// Next decoded piece of the value of keys()[key].
+        virtual void on_field_text(size_t key, std::string_view text) = 0;
+
+        /// The value of keys()[key] closed.
+        virtual void on_field_end(size_t key) = 0;
+    };
+
+    /// Throws std::invalid_argument if `keys` is empty or has more than
+    /// c_max_keys entries.
+    explicit JsonFieldExtractor(std::vector<std::string> keys);
+
+    void feed(std::string_view chunk, Listener& listener);
+
+    const std::vector<std::string>& keys() const { return m_keys; }
+
+private:
+    enum class State {
+        Structure,   ///< Between tokens
+        Key,         ///< Inside an object key
+        Skip,        ///< Inside a string we do not extract
+        Value        ///< Inside an extracted string value
+    };
+
+    void push(bool is_object);
+    void pop();
+    bool in_object() const;
+
+    /// Decoded key byte: narrow the candidate set.
+    void match_key_byte(char c);
+
+    /// Handle the character after a backslash (or a \uXXXX digit);
+    /// writes up to 7 decoded bytes to `out`, returns how many.
+    size_t decode_escape(char c, char* out);
+
+    std::vector<std::string> m_keys;
+
+    State m_state = State::Structure;
+    size_t m_depth = 0;
+    uint64_t m_object_bits = 0;      ///< Bit d set = level d is an object (first 64 levels)
+    bool m_expect_key = false;
+    size_t m_pending_key = npos;     ///< Matched key awaiting its value
+    size_t m_value_key = npos;       ///< Key whose value is being streamed
+
+    uint64_t m_candidates = 0;       ///< Keys still matching the key being read
+    size_t m_key_pos = 0;
+
+    bool m_escape = false;
+    int m_hex_digits = -1;           ///< -1 = not in \u, else digits read so far
+    uint32_t m_code_unit = 0;
+    uint32_t m_high_surrogate = 0;
+};
@@ -0,0 +1,481 @@
+// ---------------------------------------------------------------------
+// LoadGen.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+// chat_loadgen: replays a JSONL trace or a synthetic MyStoryPal mix
+// against a running ChatApp and reports latency percentiles as JSON.
+
+#include "httplib.h"
+#include "CliArgs.hpp"
+#include <json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr const std::string_view c_option_host        = "--host";
+constexpr const std::string_view c_option_port        = "--port";
+constexpr const std::string_view c_option_unix_socket = "--unix-socket";
+constexpr const std::string_view c_option_trace       = "--trace";
+constexpr const std::string_view c_option_endpoint    = "--endpoint";
+constexpr const std::string_view c_option_mode        = "--mode";
+constexpr const std::string_view c_option_concurrency = "--concurrency";
+constexpr const std::string_view c_option_rate        = "--rate";
+constexpr const std::string_view c_option_requests    = "--requests";
+constexpr const std::string_view c_option_duration    = "--duration-s";
+constexpr const std::string_view c_option_classifier  = "--classifier-share";
+constexpr const std::string_view c_option_seed        = "--seed";
+constexpr const std::string_view c_option_out         = "--out";
+constexpr const std::string_view c_option_help        = "--help";
+constexpr const std::string_view c_option_help_short  = "-h";
+
+constexpr const char* c_classifier_prompt =
+    "You are an assistant in a children's story-builder app. For each user message, decide if it is "
+    "part of the STORY or just a QUESTION/CHAT. If it is a story sentence, correct grammar/spelling "
+    "only as needed but keep the child's voice. Respond with EXACTLY ONE JSON object in the format: "
+    "{\"is_story\": true} or {\"is_story\": false}.";
+
+constexpr const char* c_correction_prompt =
+    "You are an assistant in a children's story-builder app. When a child writes a sentence, correct "
+    "grammar and spelling only when needed, while keeping their original voice and creativity intact. "
+    "After correcting, give a clear and encouraging explanation of why the change was made. The "
+    "explanation should be more than one short phrase \xe2\x80\x94 use a complete sentence or two that "
+    "helps the child learn while also feeling positive and supported.\n"
+    "Output your response as a single JSON object in the format:\n"
+    "{\"corrected_sentence\": \"sentence\", \"explanation\": \"reason\"}";
+
+constexpr const char* c_child_sentences[] = {
+    "the dragon flyed over the mountin and saw a castel",
+    "Once upon a time their was a cat who could talk",
+    "why is the sky blue",
+    "my friend sam found a magic key under his bed",
+    "The princess runned to the forest to find her dog",
+    "can you help me write a story about a robot",
+    "the little fish swimmed all the way to the big ocean",
+    "what happens next in the story",
+};
+
+void PrintHelp(const char* exe) {
+    std::cout << "\nUsage:\n"
+              << exe << " [--trace requests.jsonl] [--mode closed|open] ...\n\n"
+              << c_option_host << " <address>: ChatApp address (default: 127.0.0.1)\n"
+              << c_option_port << " <port>: ChatApp port (default: 8080)\n"
+              << c_option_unix_socket << " <path>: Connect to ChatApp's UNIX domain socket instead\n"
+              << c_option_trace << " <file.jsonl>: Requests to replay in order, one /chat body per line; a line's\n"
+              << "    \"params\" object is merged into the body and \"endpoint\" overrides " << c_option_endpoint << "\n"
+              << "    (default: synthetic MyStoryPal mix of 8-token classifier and 120-token correction calls)\n"
+              << c_option_endpoint << " </chat|/chat_stream>: Endpoint requests are sent to (default: /chat_stream)\n"
+              << c_option_mode << " <closed|open>: closed keeps --concurrency requests outstanding; open sends\n"
+              << "    Poisson arrivals at --rate regardless of completions (default: closed)\n"
+              << c_option_concurrency << " <count>: Closed-loop clients, or most outstanding open-loop requests (default: 4)\n"
+              << c_option_rate << " <req/s>: Open-loop mean arrival rate (default: 1)\n"
+              << c_option_requests << " <count>: Requests to send; 0 = until --duration-s (default: 100)\n"
+              << c_option_duration << " <seconds>: Stop sending after this long; 0 = no limit (default: 0)\n"
+              << c_option_classifier << " <fraction>: Share of classifier calls in the synthetic mix (default: 0.5)\n"
+              << c_option_seed << " <n>: Seed for arrivals and the synthetic mix (default: 1)\n"
+              << c_option_out << " <file|->: Where the JSON report goes (default: -)\n\n"
+              << "Latency is measured from a request's scheduled arrival, so an overloaded server (or\n"
+              << "client) shows up as queueing instead of a lower send rate. Inter-token latency is the\n"
+              << "gap between streamed chunks; run ChatApp with --stream-flush-ms 0 for per-token gaps.\n";
+}
+
+struct LoadRequest {
+    std::string endpoint;
+    std::string body;
+};
+
+/// Read a JSONL trace; every line becomes one request.
+bool LoadTrace(const std::string& path, const std::string& default_endpoint,
+               std::vector<LoadRequest>& out) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open trace: " << path << "\n";
+        return false;
+    }
+    std::string line;
+    for (size_t number = 1; std::getline(in, line); ++number) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+        json body;
+        try {
+            body = json::parse(line);
+        } catch (const json::parse_error& e) {
+            std::cerr << path << ":" << number << ": " << e.what() << "\n";
+            return false;
+        }
+        if (!body.is_object()) {
+            std::cerr << path << ":" << number << ": line must be an object\n";
+            return false;
+        }
+        LoadRequest request;
+        request.endpoint = body.value("endpoint", default_endpoint);
+        const auto params = body.find("params");
+        if (params != body.end() && params->is_object()) {
+            for (const auto& [key, value] : params->items()) body[key] = value;
+        }
+        body.erase("params");
+        body.erase("endpoint");
+        body.erase("id");
+        request.body = body.dump();
+        out.push_back(std::move(request));
+    }
+    if (out.empty()) {
+        std::cerr << "Trace has no requests: " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+/// The MyStoryPal traffic shape: a short JSON classifier call and a
+/// longer JSON correction call per child sentence.
+LoadRequest SyntheticRequest(std::mt19937_64& rng, double classifier_share, const std::string& endpoint) {
+    constexpr size_t sentences = sizeof(c_child_sentences) / sizeof(c_child_sentences[0]);
+    const char* sentence = c_child_sentences[std::uniform_int_distribution<size_t>(0, sentences - 1)(rng)];
+    const bool classifier = std::uniform_real_distribution<double>(0.0, 1.0)(rng) < classifier_share;
+    const json body = {
+        {"sys_prompt", classifier ? c_classifier_prompt : c_correction_prompt},
+        {"user_prompt", sentence},
+        {"max_new_tokens", classifier ? 8 : 120},
+        {"response_format", "json_object"},
+    };
+    return {endpoint, body.dump()};
+}
+
+/// Outcome of one request.
+struct Sample {
+    int status = 0;           ///< 0 = transport error
+    double e2e_s = 0.0;       ///< Scheduled arrival until the last byte
+    double ttft_s = -1.0;     ///< Scheduled arrival until the first body byte; streams only
+    size_t generated_tokens = 0;
+};
+
+/// Everything one client thread measured; merged once the run ends.
+struct ClientStats {
+    std::vector<Sample> samples;
+    std::vector<double> inter_token_s;
+    std::vector<double> send_delay_s; ///< Open loop: scheduled arrival until the request was sent
+};
+
+std::unique_ptr<httplib::Client> MakeClient(const std::string& host, int port, const std::string& unix_socket) {
+    auto client = unix_socket.empty() ? std::make_unique<httplib::Client>(host, port)
+                                      : std::make_unique<httplib::Client>(unix_socket);
+    if (!unix_socket.empty()) client->set_address_family(AF_UNIX);
+    client->set_keep_alive(true);
+    client->set_tcp_nodelay(true);
+    client->set_read_timeout(std::chrono::seconds(300));
+    return client;
+}
+
+/// Send `request` and measure it from `scheduled`.
+void Execute(httplib::Client& client, const LoadRequest& request, Clock::time_point scheduled,
+             ClientStats& stats) {
+    Sample sample;
+    const bool stream = request.endpoint != "/chat";
+    Clock::time_point last_chunk;
+    bool got_chunk = false;
+
+    httplib::Result result;
+    if (stream) {
+        httplib::Request req;
+        req.method = "POST";
+        req.path = request.endpoint;
+        req.body = request.body;
+        req.set_header("Content-Type", "application/json");
+        req.content_receiver = [&](const char*, size_t, uint64_t, uint64_t) {
+            const Clock::time_point now = Clock::now();
+            if (!got_chunk) {
+                sample.ttft_s = std::chrono::duration<double>(now - scheduled).count();
+                got_chunk = true;
+            } else {
+                stats.inter_token_s.push_back(std::chrono::duration<double>(now - last_chunk).count());
+            }
+            last_chunk = now;
+            return true;
+        };
+        result = client.send(req);
+    } else {
+        result = client.Post(request.endpoint, request.body, "application/json");
+    }
+
+    sample.e2e_s = std::chrono::duration<double>(Clock::now() - scheduled).count();
+    if (result) {
+        sample.status = result->status;
+        if (result->has_header("X-Generated-Tokens")) {
+            sample.generated_tokens = std::stoul(result->get_header_value("X-Generated-Tokens"));
+        }
+    }
+    stats.samples.push_back(sample);
+}
+
+/// Value at fraction `q` of `sorted`, or 0 if it is empty.
+double Percentile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0.0;
+    const size_t rank = static_cast<size_t>(q * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+/// {"p50":..,"p90":..,"p99":..,"p99.9":..,"max":..,"mean":..} in milliseconds.
+json Distribution(std::vector<double> seconds) {
+    std::sort(seconds.begin(), seconds.end());
+    double sum = 0.0;
+    for (double s : seconds) sum += s;
+    return {
+        {"count", seconds.size()},
+        {"p50", 1e3 * Percentile(seconds, 0.50)},
+        {"p90", 1e3 * Percentile(seconds, 0.90)},
+        {"p99", 1e3 * Percentile(seconds, 0.99)},
+        {"p99.9", 1e3 * Percentile(seconds, 0.999)},
+        {"max", seconds.empty() ? 0.0 : 1e3 * seconds.back()},
+        {"mean", seconds.empty() ? 0.0 : 1e3 * sum / static_cast<double>(seconds.size())},
+    };
+}
+
+// ---------------------------------------------------------------------
+// ArrivalQueue: open-loop arrivals waiting for a free client
+// ---------------------------------------------------------------------
+class ArrivalQueue {
+public:
+    void push(size_t index, Clock::time_point scheduled) {
+        {
+            std::lock_guard<std::mutex> lk(m_mu);
+            m_arrivals.emplace_back(index, scheduled);
+        }
+        m_cv.notify_one();
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lk(m_mu);
+            m_closed = true;
+        }
+        m_cv.notify_all();
+    }
+
+    /// Next arrival, or nullopt once closed and drained.
+    std::optional<std::pair<size_t, Clock::time_point>> pop() {
+        std::unique_lock<std::mutex> lk(m_mu);
+        m_cv.wait(lk, [this] { return m_closed || !m_arrivals.empty(); });
+        if (m_arrivals.empty()) return std::nullopt;
+        auto arrival = m_arrivals.front();
+        m_arrivals.pop_front();
+        return arrival;
+    }
+
+private:
+    std::mutex m_mu;
+    std::condition_variable m_cv;
+    std::deque<std::pair<size_t, Clock::time_point>> m_arrivals;
+    bool m_closed = false;
+};
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    std::string unix_socket;
+    std::string trace_path;
+    std::string endpoint = "/chat_stream";
+    bool open_loop = false;
+    size_t concurrency = 4;
+    double rate = 1.0;
+    size_t total_requests = 100;
+    double duration_s = 0.0;
+    double classifier_share = 0.5;
+    uint64_t seed = 1;
+    std::string out_path = "-";
+
+    for (int i = 1; i < argc; ++i) {
+        if (c_option_host == argv[i] && i + 1 < argc) {
+            host = argv[++i];
+        } else if (c_option_port == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_port, argv[++i], port)) return 1;
+        } else if (c_option_unix_socket == argv[i] && i + 1 < argc) {
+            unix_socket = argv[++i];
+        } else if (c_option_trace == argv[i] && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (c_option_endpoint == argv[i] && i + 1 < argc) {
+            endpoint = argv[++i];
+        } else if (c_option_mode == argv[i] && i + 1 < argc) {
+            const std::string_view mode = argv[++i];
+            if (mode == "open") {
+                open_loop = true;
+            } else if (mode != "closed") {
+                std::cerr << "Unknown mode: " << mode << "\n";
+                return 1;
+            }
+        } else if (c_option_concurrency == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_concurrency, argv[++i], concurrency)) return 1;
+        } else if (c_option_rate == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_rate, argv[++i], rate)) return 1;
+        } else if (c_option_requests == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_requests, argv[++i], total_requests)) return 1;
+        } else if (c_option_duration == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_duration, argv[++i], duration_s)) return 1;
+        } else if (c_option_classifier == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_classifier, argv[++i], classifier_share)) return 1;
+        } else if (c_option_seed == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_seed, argv[++i], seed)) return 1;
+        } else if (c_option_out == argv[i] && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (c_option_help == argv[i] || c_option_help_short == argv[i]) {
+            PrintHelp(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << "\n";
+            PrintHelp(argv[0]);
+            return 1;
+        }
+    }
+    if (concurrency == 0 || (open_loop && rate <= 0.0) || (total_requests == 0 && duration_s <= 0.0)) {
+        std::cerr << "Need " << c_option_concurrency << " >= 1, " << c_option_rate << " > 0 in open mode, and "
+                  << c_option_requests << " or " << c_option_duration << "\n";
+        return 1;
+    }
+
+    // Requests are generated up front so building them never delays an arrival.
+    std::vector<LoadRequest> trace;
+    if (!trace_path.empty() && !LoadTrace(trace_path, endpoint, trace)) return 1;
+    std::mt19937_64 rng(seed);
+    const size_t planned = total_requests ? total_requests
+                                          : std::max<size_t>(1, trace.empty() ? 4096 : trace.size());
+    std::vector<LoadRequest> requests;
+    requests.reserve(planned);
+    for (size_t i = 0; i < planned; ++i) {
+        requests.push_back(trace.empty() ? SyntheticRequest(rng, classifier_share, endpoint)
+                                         : trace[i % trace.size()]);
+    }
+    auto request_at = [&](size_t index) -> const LoadRequest& { return requests[index % requests.size()]; };
+
+    const Clock::time_point start = Clock::now();
+    const std::optional<Clock::time_point> deadline =
+        duration_s > 0.0 ? std::optional<Clock::time_point>(
+                               start + std::chrono::duration_cast<Clock::duration>(
+                                           std::chrono::duration<double>(duration_s)))
+                         : std::nullopt;
+    auto more = [&](size_t index, Clock::time_point now) {
+        return (total_requests == 0 || index < total_requests) && (!deadline || now < *deadline);
+    };
+
+    std::vector<ClientStats> stats(concurrency);
+    std::vector<std::thread> clients;
+    ArrivalQueue arrivals;
+    std::atomic<size_t> next_index{0};
+
+    for (size_t c = 0; c < concurrency; ++c) {
+        clients.emplace_back([&, c] {
+            auto client = MakeClient(host, port, unix_socket);
+            ClientStats& mine = stats[c];
+            if (!open_loop) {
+                // Closed loop: the next request leaves when the previous one finished
+                for (;;) {
+                    const size_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+                    const Clock::time_point now = Clock::now();
+                    if (!more(index, now)) return;
+                    Execute(*client, request_at(index), now, mine);
+                }
+            }
+            while (auto arrival = arrivals.pop()) {
+                mine.send_delay_s.push_back(
+                    std::chrono::duration<double>(Clock::now() - arrival->second).count());
+                Execute(*client, request_at(arrival->first), arrival->second, mine);
+            }
+        });
+    }
+
+    if (open_loop) {
+        // Poisson arrivals: exponential gaps, independent of completions
+        std::exponential_distribution<double> gap(rate);
+        Clock::time_point scheduled = start;
+        for (size_t index = 0; more(index, scheduled); ++index) {
+            std::this_thread::sleep_until(scheduled);
+            arrivals.push(index, scheduled);
+            scheduled += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(gap(rng)));
+        }
+        arrivals.close();
+    }
+    for (auto& client : clients) client.join();
+    const double wall_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // Merge and report
+    std::vector<double> e2e;
+    std::vector<double> ttft;
+    std::vector<double> inter_token;
+    std::vector<double> send_delay;
+    size_t sent = 0;
+    size_t ok = 0;
+    size_t rejected = 0;
+    size_t transport_errors = 0;
+    size_t generated_tokens = 0;
+    for (const ClientStats& client : stats) {
+        for (const Sample& sample : client.samples) {
+            ++sent;
+            if (sample.status == 0) {
+                ++transport_errors;
+            } else if (sample.status == 503) {
+                ++rejected;
+            } else if (sample.status == 200) {
+                ++ok;
+                e2e.push_back(sample.e2e_s);
+                if (sample.ttft_s >= 0.0) ttft.push_back(sample.ttft_s);
+                generated_tokens += sample.generated_tokens;
+            }
+        }
+        inter_token.insert(inter_token.end(), client.inter_token_s.begin(), client.inter_token_s.end());
+        send_delay.insert(send_delay.end(), client.send_delay_s.begin(), client.send_delay_s.end());
+    }
+
+    json report = {
+        {"mode", open_loop ? "open" : "closed"},
+        {"source", trace_path.empty() ? "mystorypal_mix" : trace_path},
+        {"endpoint", endpoint},
+        {"concurrency", concurrency},
+        {"duration_s", wall_s},
+        {"requests", sent},
+        {"ok", ok},
+        {"rejected_503", rejected},
+        {"errors", sent - ok - rejected},
+        {"transport_errors", transport_errors},
+        {"throughput_rps", wall_s > 0.0 ? static_cast<double>(ok) / wall_s : 0.0},
+        {"latency_ms", {
+            {"e2e", Distribution(std::move(e2e))},
+            {"ttft", Distribution(std::move(ttft))},
+            {"inter_token", Distribution(std::move(inter_token))},
+        }},
+    };
+    if (open_loop) {
+        report["offered_rps"] = rate;
+        report["latency_ms"]["client_send_delay"] = Distribution(std::move(send_delay));
+    }
+    if (generated_tokens > 0) {
+        // Reported by /chat only; streamed responses carry the count as a trailer
+        report["generated_tok_per_s"] = static_cast<double>(generated_tokens) / wall_s;
+    }
+
+    const std::string text = report.dump(2) + "\n";
+    if (out_path == "-") {
+        std::cout << text;
+    } else {
+        std::ofstream out(out_path, std::ios::trunc);
+        out << text;
+        if (!out) {
+            std::cerr << "Failed to write report: " << out_path << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,296 @@
+// ---------------------------------------------------------------------
+// Log.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "Log.hpp"
+#include "Hash.hpp"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+namespace {
+    struct RecordHeader {
+        int64_t time_ns;  ///< system_clock since the epoch
+        uint32_t length;  ///< Message bytes that follow
+        LogLevel level;
+    };
+
+    /// A drained record, ready to be ordered and formatted.
+    struct Record {
+        RecordHeader header;
+        uint32_t thread;
+        std::string message;
+    };
+
+    int64_t NowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    /// "2026-01-31T12:00:00.123Z INFO  [t3] message\n"
+    void AppendLine(std::string& out, int64_t time_ns, LogLevel level, uint32_t thread,
+                    std::string_view message) {
+        const std::time_t seconds = static_cast<std::time_t>(time_ns / 1000000000);
+        std::tm utc{};
+#ifdef _WIN32
+        gmtime_s(&utc, &seconds);
+#else
+        gmtime_r(&seconds, &utc);
+#endif
+        char stamp[64];
+        const int n = std::snprintf(stamp, sizeof(stamp), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ %-5s [t%u] ",
+                                    utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+                                    utc.tm_hour, utc.tm_min, utc.tm_sec,
+                                    static_cast<int>((time_ns / 1000000) % 1000),
+                                    to_string(level), thread);
+        out.append(stamp, static_cast<size_t>(n));
+        out.append(message);
+        out += '\n';
+    }
+} // namespace
+
+const char* to_string(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info:  return "INFO";
+        case LogLevel::Warn:  return "WARN";
+        case LogLevel::Error: return "ERROR";
+        case LogLevel::Off:   return "OFF";
+    }
+    return "?";
+}
+
+std::optional<LogLevel> parse_log_level(std::string_view name) {
+    if (name == "debug") return LogLevel::Debug;
+    if (name == "info")  return LogLevel::Info;
+    if (name == "warn")  return LogLevel::Warn;
+    if (name == "error") return LogLevel::Error;
+    if (name == "off")   return LogLevel::Off;
+    return std::nullopt;
+}
+
+// ---------------------------------------------------------------------
+// ThreadBuffer: single-producer/single-consumer record ring
+// ---------------------------------------------------------------------
+/// Written only by its owning thread, read only by the writer thread.
+/// Records are [RecordHeader][message bytes], wrapping around the end.
+class Logger::ThreadBuffer {
+public:
+    ThreadBuffer(size_t capacity, uint32_t thread) : m_thread(thread) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        m_data.resize(size);
+        m_mask = size - 1;
+    }
+
+    /// False if the record does not fit.
+    bool push(int64_t time_ns, LogLevel level, std::string_view message) {
+        // A single record may take at most a quarter of the ring
+        const size_t max_message = m_data.size() / 4;
+        if (message.size() > max_message) message = message.substr(0, max_message);
+
+        const RecordHeader header{time_ns, static_cast<uint32_t>(message.size()), level};
+        const size_t need = sizeof(header) + message.size();
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        if (need > m_data.size() - (head - tail)) return false;
+
+        copy_in(head, &header, sizeof(header));
+        copy_in(head + sizeof(header), message.data(), message.size());
+        m_head.store(head + need, std::memory_order_release);
+        return true;
+    }
+
+    /// Move every complete record into `out`.
+    void drain(std::vector<Record>& out) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t head = m_head.load(std::memory_order_acquire);
+        while (tail != head) {
+            Record record;
+            record.thread = m_thread;
+            copy_out(tail, &record.header, sizeof(record.header));
+            record.message.resize(record.header.length);
+            copy_out(tail + sizeof(record.header), record.message.data(), record.header.length);
+            tail += sizeof(record.header) + record.header.length;
+            out.push_back(std::move(record));
+        }
+        m_tail.store(tail, std::memory_order_release);
+    }
+
+    uint32_t thread() const { return m_thread; }
+
+    std::atomic<bool> orphaned{false}; ///< Owning thread has exited
+
+private:
+    void copy_in(size_t pos, const void* src, size_t len) {
+        const size_t offset = pos & m_mask;
+        const size_t first = std::min(len, m_data.size() - offset);
+        std::memcpy(m_data.data() + offset, src, first);
+        std::memcpy(m_data.data(), static_cast<const char*>(src) + first, len - first);
+    }
+
+    void copy_out(size_t pos, void* dst, size_t len) const {
+        const size_t offset = pos & m_mask;
+        const size_t first = std::min(len, m_data.size() - offset);
+        std::memcpy(dst, m_data.data() + offset, first);
+        std::memcpy(static_cast<char*>(dst) + first, m_data.data(), len - first);
+    }
+
+    const uint32_t m_thread;
+    std::vector<char> m_data;
+    size_t m_mask = 0;
+    std::atomic<size_t> m_head{0}; ///< Bytes ever written; producer-owned
+    std::atomic<size_t> m_tail{0}; ///< Bytes ever read; consumer-owned
+};
+
+namespace {
+    /// Marks the thread's buffer orphaned when the thread exits, so the
+    /// writer can drop it once drained.
+    struct LocalBuffer {
+        std::shared_ptr<void> buffer;
+        std::atomic<bool>* orphaned = nullptr;
+        ~LocalBuffer() {
+            if (orphaned) orphaned->store(true, std::memory_order_release);
+        }
+    };
+    thread_local LocalBuffer t_local;
+} // namespace
+
+// ---------------------------------------------------------------------
+// Logger Implementation
+// ---------------------------------------------------------------------
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::~Logger()
+{
+    stop();
+}
+
+void Logger::start(const LoggerConfig& config) {
+    stop();
+    std::lock_guard<std::mutex> lk(m_mu);
+    m_config = config;
+    m_level.store(config.level, std::memory_order_relaxed);
+    m_stopping = false;
+    m_running = true;
+    m_writer = std::thread([this] { writer_loop(); });
+    m_accepting.store(true, std::memory_order_release);
+}
+
+void Logger::stop() {
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        if (!m_running) return;
+        m_accepting.store(false, std::memory_order_release);
+        m_stopping = true;
+    }
+    m_cv.notify_one();
+    m_writer.join();
+
+    std::lock_guard<std::mutex> lk(m_mu);
+    m_running = false;
+}
+
+void Logger::write(LogLevel level, std::string_view message) {
+    if (!m_accepting.load(std::memory_order_acquire)) {
+        // No writer thread (before start() or after stop()): write through.
+        std::string line;
+        AppendLine(line, NowNs(), level, 0, message);
+        std::lock_guard<std::mutex> lk(m_mu);
+        std::fwrite(line.data(), 1, line.size(), m_config.sink);
+        std::fflush(m_config.sink);
+        return;
+    }
+
+    if (!local_buffer().push(NowNs(), level, message)) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (level >= LogLevel::Error) {
+        m_cv.notify_one();
+    }
+}
+
+Logger::ThreadBuffer& Logger::local_buffer() {
+    if (!t_local.buffer) {
+        std::lock_guard<std::mutex> lk(m_mu);
+        auto buffer = std::make_shared<ThreadBuffer>(m_config.thread_buffer_bytes,
+                                                     static_cast<uint32_t>(m_buffers.size() + 1));
+        m_buffers.push_back(buffer);
+        t_local.orphaned = &buffer->orphaned;
+        t_local.buffer = std::move(buffer);
+    }
+    return *static_cast<ThreadBuffer*>(t_local.buffer.get());
+}
+
+std::string Logger::prompt(std::string_view text) const {
+    switch (m_config.prompt_mode) {
+        case PromptLogMode::Full:
+            return std::string(text);
+        case PromptLogMode::Truncate:
+            if (text.size() <= m_config.prompt_max_bytes) return std::string(text);
+            return std::string(text.substr(0, m_config.prompt_max_bytes)) + "...(+" +
+                   std::to_string(text.size() - m_config.prompt_max_bytes) + " bytes)";
+        case PromptLogMode::Hash: {
+            char out[64];
+            std::snprintf(out, sizeof(out), "<%zu bytes, fnv1a %016llx>", text.size(),
+                          static_cast<unsigned long long>(fnv1a64(text)));
+            return out;
+        }
+    }
+    return {};
+}
+
+void Logger::writer_loop() {
+    std::string batch;
+    std::unique_lock<std::mutex> lk(m_mu);
+    for (;;) {
+        const bool stopping = m_stopping;
+        lk.unlock();
+        drain(batch);
+        lk.lock();
+        if (stopping) return;
+        m_cv.wait_for(lk, m_config.flush_interval);
+    }
+}
+
+void Logger::drain(std::string& batch) {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        buffers = m_buffers;
+    }
+
+    std::vector<Record> records;
+    std::vector<ThreadBuffer*> finished;
+    for (const auto& buffer : buffers) {
+        // Checked before draining: an orphan cannot receive new records
+        const bool orphaned = buffer->orphaned.load(std::memory_order_acquire);
+        buffer->drain(records);
+        if (orphaned) finished.push_back(buffer.get());
+    }
+    if (!finished.empty()) {
+        std::lock_guard<std::mutex> lk(m_mu);
+        m_buffers.erase(std::remove_if(m_buffers.begin(), m_buffers.end(),
+                                       [&](const auto& buffer) {
+                                           return std::find(finished.begin(), finished.end(),
+                                                            buffer.get()) != finished.end();
+                                       }),
+                        m_buffers.end());
+    }
+    if (records.empty()) return;
+
+    std::stable_sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+        return a.header.time_ns < b.header.time_ns;
+    });
+    batch.clear();
+    for (const Record& record : records) {
+        AppendLine(batch, record.header.time_ns, record.header.level, record.thread, record.message);
+    }
+    std::fwrite(batch.data(), 1, batch.size(), m_config.sink);
+    std::fflush(m_config.sink);
+}
@@ -0,0 +1,116 @@
+// ---------------------------------------------------------------------
+// Log.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+enum class LogLevel { Debug, Info, Warn, Error, Off };
+
+const char* to_string(LogLevel level);
+
+/// Parse "debug", "info", "warn", "error" or "off".
+std::optional<LogLevel> parse_log_level(std::string_view name);
+
+/// How request bodies and prompts appear in the log.
+enum class PromptLogMode {
+    Full,      ///< Verbatim
+    Truncate,  ///< First prompt_max_bytes, then the number of bytes cut
+    Hash       ///< Length and FNV-1a hash only; no user text in the log
+};
+
+// ---------------------------------------------------------------------
+// LoggerConfig
+// ---------------------------------------------------------------------
+struct LoggerConfig {
+    LogLevel level = LogLevel::Info;
+    size_t thread_buffer_bytes = 64 << 10;          ///< Per-thread ring; records that do not fit are dropped
+    std::chrono::milliseconds flush_interval{100};  ///< Longest a record waits before it is written
+    PromptLogMode prompt_mode = PromptLogMode::Truncate;
+    size_t prompt_max_bytes = 200;                  ///< Used by PromptLogMode::Truncate
+    FILE* sink = stderr;
+};
+
+// ---------------------------------------------------------------------
+// Logger: leveled logging off the request path
+// ---------------------------------------------------------------------
+/// A log call copies one record into a lock-free ring owned by the
+/// calling thread and returns; a background writer drains every ring,
+/// orders the records by time and writes them in a single batch. A
+/// record that does not fit in its ring is dropped and counted rather
+/// than blocking the caller. Disabled levels cost one relaxed load when
+/// logged through CHATAPP_LOG. Until start() is called, records are
+/// written synchronously so early start-up messages are not lost.
+class Logger {
+public:
+    static Logger& instance();
+
+    /// Apply `config` and start the writer thread.
+    void start(const LoggerConfig& config);
+
+    /// Write everything still buffered and stop the writer thread.
+    void stop();
+
+    bool enabled(LogLevel level) const {
+        return level >= m_level.load(std::memory_order_relaxed) && level != LogLevel::Off;
+    }
+    void set_level(LogLevel level) { m_level.store(level, std::memory_order_relaxed); }
+    LogLevel level() const { return m_level.load(std::memory_order_relaxed); }
+
+    void write(LogLevel level, std::string_view message);
+
+    /// `text` rendered for the log according to the prompt mode.
+    std::string prompt(std::string_view text) const;
+
+    /// Records dropped because their thread's ring was full.
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    class ThreadBuffer;
+
+    Logger() = default;
+    ~Logger();
+
+    ThreadBuffer& local_buffer();
+    void writer_loop();
+    void drain(std::string& batch);
+
+    std::atomic<LogLevel> m_level{LogLevel::Info};
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<bool> m_accepting{false};              ///< Writer running; log through the rings
+    LoggerConfig m_config;
+
+    std::mutex m_mu;                                    ///< Guards the fields below
+    std::condition_variable m_cv;
+    std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+    bool m_running = false;
+    bool m_stopping = false;
+    std::thread m_writer;
+};
+
+/// Log `message` (anything streamable, e.g. "x=" << x) at `level`. The
+/// message is not formatted unless the level is enabled.
+#define CHATAPP_LOG(level, message)                                            \
+    do {                                                                       \
+        Logger& chatapp_logger_ = Logger::instance();                          \
+        if (chatapp_logger_.enabled(level)) {                                  \
+            std::ostringstream chatapp_log_stream_;                            \
+            chatapp_log_stream_ << message;                                    \
+            chatapp_logger_.write(level, chatapp_log_stream_.str());           \
+        }                                                                      \
+    } while (0)
@@ -1,34 +1,814 @@
 // chat_server.cpp
 #include "httplib.h"
+#include "BatchRunner.hpp"
 #include "ChatManager.hpp"
+#include "CliArgs.hpp"
+#include "EventLoopServer.hpp"
+#include "InferenceQueue.hpp"
+#include "JobStore.hpp"
+#include "Log.hpp"
+#include "Metrics.hpp"
+#include "ResponseCache.hpp"
+#include "SingleFlight.hpp"
+#include "StreamEncoder.hpp"
+#include "TokenRing.hpp"
+#include "Trace.hpp"
+#include "WireFormat.hpp"
+#include "StandInBackend.hpp"
+#ifdef CHATAPP_WITH_GENIE
+#include "GenieBackend.hpp"
+#endif
 
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <filesystem>
 #include <json.hpp>      // if this fails on your setup, use: #include <nlohmann/json.hpp>
-#include <mutex>
+#include <atomic>
 #include <cstring>       // strlen
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/stat.h>
+#endif
 
 using json = nlohmann::json;
 
 namespace {
 constexpr const std::string_view c_option_genie_config = "--genie-config";
 constexpr const std::string_view c_option_base_dir    = "--base-dir";
+constexpr const std::string_view c_option_backend     = "--backend";
+constexpr const std::string_view c_option_dialogs     = "--dialogs";
+constexpr const std::string_view c_option_queue_depth = "--queue-depth";
+constexpr const std::string_view c_option_queue_wait  = "--queue-max-wait-ms";
+constexpr const std::string_view c_option_schedule    = "--schedule";
+constexpr const std::string_view c_option_sjf_aging   = "--sjf-aging";
+constexpr const std::string_view c_option_prefix_cache = "--prefix-cache-mb";
+constexpr const std::string_view c_option_response_cache = "--response-cache-mb";
+constexpr const std::string_view c_option_response_ttl = "--response-cache-ttl-s";
+constexpr const std::string_view c_option_flush_ms     = "--stream-flush-ms";
+constexpr const std::string_view c_option_flush_bytes  = "--stream-flush-bytes";
+constexpr const std::string_view c_option_ring_kb      = "--stream-ring-kb";
+constexpr const std::string_view c_option_overflow     = "--stream-overflow";
+constexpr const std::string_view c_option_job_backlog  = "--job-backlog";
+constexpr const std::string_view c_option_job_ttl      = "--job-ttl-s";
+constexpr const std::string_view c_option_job_in_queue = "--job-max-in-queue";
+constexpr const std::string_view c_option_log_level    = "--log-level";
+constexpr const std::string_view c_option_log_prompts  = "--log-prompts";
+constexpr const std::string_view c_option_log_prompt_bytes = "--log-prompt-bytes";
+constexpr const std::string_view c_option_trace_rate   = "--trace-sample-rate";
+constexpr const std::string_view c_option_trace_spans  = "--trace-buffer-spans";
+constexpr const std::string_view c_option_host         = "--host";
+constexpr const std::string_view c_option_port         = "--port";
+constexpr const std::string_view c_option_unix_socket  = "--unix-socket";
+constexpr const std::string_view c_option_unix_mode    = "--unix-socket-mode";
+constexpr const std::string_view c_option_event_port   = "--event-loop-port";
+constexpr const std::string_view c_option_event_threads = "--event-loop-threads";
+constexpr const std::string_view c_option_batch_in     = "--batch";
+constexpr const std::string_view c_option_batch_out    = "--out";
+constexpr const std::string_view c_option_batch_concurrency = "--batch-concurrency";
+constexpr const std::string_view c_option_prefill_rate = "--standin-prefill-rate";
+constexpr const std::string_view c_option_decode_rate  = "--standin-decode-rate";
+constexpr const std::string_view c_option_reply_tokens = "--standin-reply-tokens";
+constexpr const std::string_view c_option_trailing_tokens = "--standin-trailing-tokens";
 constexpr const std::string_view c_option_help        = "--help";
 constexpr const std::string_view c_option_help_short  = "-h";
 
+/// Longest the stream writer sleeps before re-checking its job; tokens wake it sooner.
+constexpr std::chrono::milliseconds c_ring_poll_interval{10};
+/// How often the event loop checks its queued jobs for max_wait.
+constexpr std::chrono::milliseconds c_event_loop_tick{50};
+
 void PrintHelp(const char* exe) {
     std::cout << "\nUsage:\n"
               << exe << " --genie-config <config.json> --base-dir <dir>\n\n"
-              << c_option_genie_config << " <Local file path>: [Required] Path to Genie config JSON\n"
-              << c_option_base_dir    << " <Local directory path>: [Required] Working directory\n";
+              << c_option_genie_config << " <Local file path>: [Required for genie] Path to Genie config JSON\n"
+              << c_option_base_dir    << " <Local directory path>: [Required for genie] Working directory\n"
+              << c_option_backend     << " <genie|standin>: Inference backend (default: "
+#ifdef CHATAPP_WITH_GENIE
+              << "genie"
+#else
+              << "standin"
+#endif
+              << ")\n"
+              << c_option_dialogs     << " <count>: Pre-created dialog handles serving requests concurrently (default: 1)\n"
+              << c_option_queue_depth << " <count>: Requests allowed to wait for a dialog before 503 (default: 16)\n"
+              << c_option_queue_wait  << " <ms>: Longest a request may wait in the queue before 503 (default: 10000)\n"
+              << c_option_schedule    << " <fifo|sjf>: Queue order; sjf runs cheapest estimated job first (default: fifo)\n"
+              << c_option_sjf_aging   << " <factor>: sjf seconds of cost forgiven per second waited (default: 2)\n"
+              << c_option_prefix_cache << " <MiB>: Budget for cached system-prompt prefill state; 0 disables (default: 0)\n"
+              << c_option_response_cache << " <MiB>: Budget for cached responses to deterministic requests; 0 disables (default: 0)\n"
+              << c_option_response_ttl << " <seconds>: Lifetime of a cached response (default: 300)\n"
+              << c_option_flush_ms << " <ms>: Coalesce streamed tokens for up to this long per write; 0 writes every token (default: 50)\n"
+              << c_option_flush_bytes << " <bytes>: Write a stream buffer once it holds this much (default: 4096)\n"
+              << c_option_ring_kb << " <KiB>: Per-stream token buffer between the inference and HTTP threads (default: 16)\n"
+              << c_option_overflow << " <spill|cancel>: When a stream client falls a full buffer behind, spill to memory or drop it (default: spill)\n"
+              << c_option_job_backlog << " <count>: Async jobs accepted but not yet finished before POST /jobs returns 503 (default: 1024)\n"
+              << c_option_job_ttl << " <seconds>: How long finished async job results are kept (default: 600)\n"
+              << c_option_job_in_queue << " <count>: Most async jobs queued or generating at once, leaving the rest of the queue to /chat (default: a quarter of the queue depth, at least 1)\n"
+              << c_option_log_level << " <debug|info|warn|error|off>: Least severe log level written (default: info)\n"
+              << c_option_log_prompts << " <full|truncate|hash>: How prompts and bodies appear in debug logs (default: truncate)\n"
+              << c_option_log_prompt_bytes << " <bytes>: Prompt bytes kept by " << c_option_log_prompts << " truncate (default: 200)\n"
+              << c_option_trace_rate << " <fraction>: Share of requests whose spans GET /debug/trace returns; 0 disables (default: 0)\n"
+              << c_option_trace_spans << " <count>: Most recent spans kept per thread (default: 8192)\n"
+              << c_option_host << " <address>: TCP address to listen on, for the event loop too (default: 0.0.0.0)\n"
+              << c_option_port << " <port>: TCP port to listen on; 0 serves only " << c_option_unix_socket << " (default: 8080)\n"
+              << c_option_unix_socket << " <path>: Also serve every endpoint on this UNIX domain socket (default: none)\n"
+              << c_option_unix_mode << " <octal>: Permissions of the UNIX domain socket file (default: 660)\n"
+              << c_option_event_port << " <port>: Also serve /hi, /chat and /chat_stream from an epoll event loop on this port; 0 disables (default: 0)\n"
+              << c_option_event_threads << " <count>: Event loop threads for " << c_option_event_port << " (default: 2)\n"
+              << c_option_batch_in << " <in.jsonl|->: Run every request in the file (one /chat_batch item per line) and exit instead of serving HTTP\n"
+              << c_option_batch_out << " <out.jsonl|->: Where " << c_option_batch_in << " writes one result per input line, in input order (default: -)\n"
+              << c_option_batch_concurrency << " <count>: Most items of one POST /chat_batch generating or queued at once (default: half the dialogs, at least 1)\n"
+              << c_option_prefill_rate << " <tok/s>: Stand-in prompt processing rate (default: 300)\n"
+              << c_option_decode_rate  << " <tok/s>: Stand-in token generation rate (default: 12)\n"
+              << c_option_reply_tokens << " <count>: Stand-in tokens per reply (default: 24)\n"
+              << c_option_trailing_tokens << " <count>: Stand-in tokens emitted after the reply's JSON (default: 0)\n\n"
+              << "The stand-in backend does not need " << c_option_genie_config
+              << " or " << c_option_base_dir << ".\n";
+}
+
+/// Read the optional decoding controls clients send next to the prompts
+/// (max_new_tokens, temperature, top_p, stop, response_format). A
+/// response_format of "json_object" (or {"type": "json_object"}) ends
+/// generation as soon as the model's JSON object closes. Returns false and fills
+/// `error` if a field has the wrong type or range.
+bool ParseGenerationParams(const json& body, GenerationParams& params, std::string& error) {
+    try {
+        if (body.contains("max_new_tokens")) {
+            const auto& v = body["max_new_tokens"];
+            if (!v.is_number_integer() || v.get<long long>() <= 0) {
+                error = "max_new_tokens must be a positive integer";
+                return false;
+            }
+            params.max_new_tokens = v.get<size_t>();
+        }
+        if (body.contains("temperature")) {
+            const float t = body["temperature"].get<float>();
+            if (t < 0.0f) {
+                error = "temperature must be >= 0";
+                return false;
+            }
+            params.temperature = t;
+        }
+        if (body.contains("top_p")) {
+            const float p = body["top_p"].get<float>();
+            if (p <= 0.0f || p > 1.0f) {
+                error = "top_p must be in (0, 1]";
+                return false;
+            }
+            params.top_p = p;
+        }
+        if (body.contains("stop")) {
+            const auto& v = body["stop"];
+            if (v.is_string()) {
+                params.stop.push_back(v.get<std::string>());
+            } else {
+                params.stop = v.get<std::vector<std::string>>();
+            }
+        }
+        if (body.contains("response_format")) {
+            const auto& v = body["response_format"];
+            const std::string type = v.is_object() ? v.value("type", "") : v.get<std::string>();
+            if (type == "json_object") {
+                params.stop_at_json_end = true;
+            } else if (type != "text") {
+                error = "response_format must be \"text\" or \"json_object\"";
+                return false;
+            }
+        }
+    } catch (const json::exception& e) {
+        error = std::string("Invalid generation parameter: ") + e.what();
+        return false;
+    }
+    return true;
+}
+
+/// Decode a request body as JSON, or as msgpack/CBOR when its
+/// Content-Type says so. On failure fills `res` with a 400.
+bool ParseRequestBody(const httplib::Request& req, httplib::Response& res, json& out) {
+    CHATAPP_TRACE_SPAN("parse_body");
+    const auto format = binary_format_from_content_type(req.get_header_value("Content-Type"));
+    try {
+        out = parse_body(req.body, format);
+    } catch (const json::exception& e) {
+        res.status = 400;
+        res.set_content(std::string(format ? "Body parse error: " : "JSON parse error: ") + e.what(),
+                        "text/plain");
+        return false;
+    }
+    return true;
+}
+
+/// Read the "sys_prompt" and "user_prompt" strings of a request object.
+/// Returns false and fills `error` if either is missing, empty or not a
+/// string.
+bool ReadPrompts(const json& body, std::string& sys_prompt, std::string& user_prompt, std::string& error) {
+    const auto sys = body.find("sys_prompt");
+    const auto user = body.find("user_prompt");
+    if ((sys != body.end() && !sys->is_string()) || (user != body.end() && !user->is_string())) {
+        error = "sys_prompt and user_prompt must be strings";
+        return false;
+    }
+    sys_prompt = sys != body.end() ? sys->get<std::string>() : std::string();
+    user_prompt = user != body.end() ? user->get<std::string>() : std::string();
+    if (sys_prompt.empty() || user_prompt.empty()) {
+        error = "sys_prompt and user_prompt required";
+        return false;
+    }
+    return true;
+}
+
+/// Fields shared by every chat request body.
+struct ChatRequest {
+    json body;
+    std::string sys_prompt;
+    std::string user_prompt;
+    GenerationParams params;
+};
+
+/// Parse and validate a chat request body. On failure fills `res` with
+/// a 400 and returns false.
+bool ParseChatRequest(const httplib::Request& req, httplib::Response& res, ChatRequest& out) {
+    if (!ParseRequestBody(req, res, out.body)) return false;
+    if (!out.body.is_object()) {
+        res.status = 400;
+        res.set_content("Error: request body must be an object", "text/plain");
+        return false;
+    }
+
+    std::string error;
+    const bool has_prompts = ReadPrompts(out.body, out.sys_prompt, out.user_prompt, error);
+    CHATAPP_LOG(LogLevel::Debug, req.path << " sys_prompt: " << Logger::instance().prompt(out.sys_prompt));
+    CHATAPP_LOG(LogLevel::Debug, req.path << " user_prompt: " << Logger::instance().prompt(out.user_prompt));
+    CHATAPP_TRACE_SPAN("validate_request");
+
+    if (!has_prompts || !ParseGenerationParams(out.body, out.params, error)) {
+        res.status = 400;
+        res.set_content("Error: " + error, "text/plain");
+        return false;
+    }
+    return true;
+}
+
+/// Per-response generation metadata and KPIs, sent as headers on /chat
+/// and as trailers on /chat_stream.
+httplib::Headers GenerationMetadata(const GenerationResult& result) {
+    return {
+        {"X-Finish-Reason", to_string(result.finish_reason)},
+        {"X-Generated-Tokens", std::to_string(result.generated_tokens)},
+        {"X-Tokens-Saved", std::to_string(result.tokens_saved)},
+        {"X-Prompt-Tokens", std::to_string(result.prompt_tokens)},
+        {"X-Prefill-Us", std::to_string(result.prefill_us)},
+        {"X-Decode-Us", std::to_string(result.decode_us)},
+    };
+}
+
+/// Body of a /chat response: the raw output as text/plain, or, when the
+/// client accepts msgpack/CBOR, a map with the output, token counts and
+/// timing. Metadata headers are set either way.
+void SetChatContent(const httplib::Request& req, httplib::Response& res, const std::string& output,
+                    const GenerationResult& result, std::chrono::steady_clock::time_point request_start) {
+    for (const auto& [key, value] : GenerationMetadata(result)) {
+        res.set_header(key, value);
+    }
+    const auto binary = binary_format_from_accept(req.get_header_value("Accept"));
+    if (!binary) {
+        res.set_content(output, "text/plain");
+        return;
+    }
+    std::string body;
+    append_binary(body, {
+        {"output", output},
+        {"finish_reason", to_string(result.finish_reason)},
+        {"generated_tokens", result.generated_tokens},
+        {"tokens_saved", result.tokens_saved},
+        {"prompt_tokens", result.prompt_tokens},
+        {"prefill_us", result.prefill_us},
+        {"decode_us", result.decode_us},
+        {"total_ms", std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - request_start).count()},
+    }, *binary);
+    res.set_content(std::move(body), content_type(*binary));
+}
+
+/// Whether a request may be served from the response cache: decoding
+/// is greedy (temperature 0) or the client opts in with "cache": true.
+bool UseResponseCache(const ResponseCache* cache, const json& body, const GenerationParams& params) {
+    if (!cache) return false;
+    const auto it = body.find("cache");
+    const bool opt_in = it != body.end() && it->is_boolean() && it->get<bool>();
+    return ResponseCache::is_cacheable(params, opt_in);
+}
+
+/// Run `job` as the leader of a coalesced generation: its chunks are
+/// published to attached followers, it is cancelled once every client
+/// has detached, and followers receive its result or error. If given,
+/// `drive` runs on the calling thread while the job is queued and
+/// generating (and must return once pending.poll() is true). The job
+/// has always finished when this returns or throws, so its callback may
+/// capture locals by reference.
+GenerationResult RunLeader(InferenceQueue& queue, SingleFlight& flights, const RequestKey& key,
+                           const std::shared_ptr<SharedGeneration>& generation,
+                           InferenceQueue::Slot slot, InferenceJob job,
+                           const std::function<void(InferenceQueue::PendingJob&)>& drive = nullptr) {
+    job.callback = [generation, callback = std::move(job.callback)](const char* text, SentenceCode code) {
+        generation->publish(text);
+        callback(text, code);
+    };
+    job.cancel = generation->cancel();
+
+    auto pending = queue.submit(std::move(slot), std::move(job));
+    GenerationResult result;
+    try {
+        if (drive) {
+            try {
+                drive(pending);
+            } catch (...) {
+                generation->detach();
+                try { pending.wait(); } catch (...) {}
+                throw;
+            }
+        }
+        result = pending.wait();
+    } catch (...) {
+        flights.complete(key, generation, std::current_exception());
+        throw;
+    }
+    flights.complete(key, generation, result);
+    return result;
+}
+
+/// Longest GET /jobs/{id}?wait_ms= may hold the connection.
+constexpr std::chrono::milliseconds c_job_max_wait{60000};
+
+/// JSON view of an async job for GET /jobs/{id}.
+json JobJson(const JobStore::Snapshot& job) {
+    json out = {
+        {"id", job.id},
+        {"status", to_string(job.status)},
+        {"output", job.output},
+    };
+    if (job.finished()) {
+        out["finish_reason"] = to_string(job.result.finish_reason);
+        out["generated_tokens"] = job.result.generated_tokens;
+        out["tokens_saved"] = job.result.tokens_saved;
+        out["prompt_tokens"] = job.result.prompt_tokens;
+        out["prefill_us"] = job.result.prefill_us;
+        out["decode_us"] = job.result.decode_us;
+    }
+    if (!job.error.empty()) {
+        out["error"] = job.error;
+    }
+    return out;
+}
+
+// ---------------------------------------------------------------------
+// ServerGroup: the same routes on every listener
+// ---------------------------------------------------------------------
+/// One httplib::Server per listening socket (TCP, UNIX domain), each
+/// registered with identical routes and settings. Mirrors the subset of
+/// the httplib::Server interface used by main().
+class ServerGroup {
+public:
+    httplib::Server& add() {
+        m_servers.push_back(std::make_unique<httplib::Server>());
+        return *m_servers.back();
+    }
+
+    template <typename Handler>
+    void Get(const std::string& pattern, const Handler& handler) {
+        for (auto& server : m_servers) server->Get(pattern, handler);
+    }
+    template <typename Handler>
+    void Post(const std::string& pattern, const Handler& handler) {
+        for (auto& server : m_servers) server->Post(pattern, handler);
+    }
+    template <typename Handler>
+    void Delete(const std::string& pattern, const Handler& handler) {
+        for (auto& server : m_servers) server->Delete(pattern, handler);
+    }
+    template <typename Handler>
+    void set_exception_handler(const Handler& handler) {
+        for (auto& server : m_servers) server->set_exception_handler(handler);
+    }
+    void set_payload_max_length(size_t length) {
+        for (auto& server : m_servers) server->set_payload_max_length(length);
+    }
+    template <typename Handler>
+    void set_pre_routing_handler(const Handler& handler) {
+        for (auto& server : m_servers) server->set_pre_routing_handler(handler);
+    }
+    template <typename Logger>
+    void set_logger(const Logger& logger) {
+        for (auto& server : m_servers) server->set_logger(logger);
+    }
+
+    /// Serve on every bound listener until they stop.
+    void listen_after_bind() {
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < m_servers.size(); ++i) {
+            threads.emplace_back([server = m_servers[i].get()] { server->listen_after_bind(); });
+        }
+        m_servers.front()->listen_after_bind();
+        for (auto& thread : threads) thread.join();
+    }
+
+private:
+    std::vector<std::unique_ptr<httplib::Server>> m_servers;
+};
+
+/// True if connecting to the UNIX socket at `path` is refused, i.e. the
+/// file was left behind by a process that is gone. False if someone is
+/// listening on it or the probe fails for another reason.
+bool IsStaleUnixSocket(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) return false;
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    const auto sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+#ifdef _WIN32
+    if (sock == INVALID_SOCKET) return false;
+    const bool refused = ::connect(sock, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 &&
+                         WSAGetLastError() == WSAECONNREFUSED;
+    ::closesocket(sock);
+#else
+    if (sock < 0) return false;
+    const bool refused = ::connect(sock, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 &&
+                         errno == ECONNREFUSED;
+    ::close(sock);
+#endif
+    return refused;
+}
+
+/// Bind `server` to a UNIX domain socket at `path` with permissions
+/// `mode`, replacing a stale socket file left by an earlier run but
+/// never the socket of a live one.
+bool BindUnixSocket(httplib::Server& server, const std::string& path, std::filesystem::perms mode) {
+    std::error_code ec;
+    if (std::filesystem::is_socket(path, ec)) {
+        if (!IsStaleUnixSocket(path)) {
+            std::cerr << "UNIX socket " << path << " is in use by another process\n";
+            return false;
+        }
+        std::filesystem::remove(path, ec);
+    }
+    server.set_address_family(AF_UNIX);
+#ifndef _WIN32
+    // The socket file is created by bind(); make it no more permissive
+    // than `mode` from the start instead of fixing it up afterwards.
+    // Only startup runs here, so the process-wide umask change is safe.
+    const mode_t previous_umask = ::umask(static_cast<mode_t>(~static_cast<unsigned>(mode) & 0777));
+    const bool bound = server.bind_to_port(path, 80); // port is ignored for AF_UNIX, but 0 would query it
+    ::umask(previous_umask);
+#else
+    const bool bound = server.bind_to_port(path, 80); // port is ignored for AF_UNIX, but 0 would query it
+#endif
+    if (!bound) {
+        std::cerr << "Cannot listen on UNIX socket " << path << "\n";
+        return false;
+    }
+    std::filesystem::permissions(path, mode, ec);
+    if (ec) {
+        std::cerr << "Cannot set permissions of " << path << ": " << ec.message() << "\n";
+        return false;
+    }
+    return true;
+}
+
+/// Longest the batch writer sleeps before retrying admission of its next item.
+constexpr std::chrono::milliseconds c_batch_poll_interval{50};
+
+/// Parse one element of a /chat_batch "items" array. Decoding controls
+/// may sit in a nested "params" object or next to the prompts.
+bool ParseBatchItem(const json& item, BatchItem& out, std::string& error) {
+    if (!item.is_object()) {
+        error = "item must be an object";
+        return false;
+    }
+    if (!ReadPrompts(item, out.sys_prompt, out.user_prompt, error)) return false;
+    const auto params = item.find("params");
+    if (params != item.end() && !params->is_object()) {
+        error = "params must be an object";
+        return false;
+    }
+    return ParseGenerationParams(params != item.end() ? *params : item, out.params, error);
+}
+
+/// One NDJSON line of a /chat_batch response.
+json BatchOutcomeJson(const BatchOutcome& outcome) {
+    json out = {{"index", outcome.index}};
+    if (!outcome.error.empty()) {
+        out["error"] = outcome.error;
+        return out;
+    }
+    out["output"] = outcome.output;
+    out["finish_reason"] = to_string(outcome.result.finish_reason);
+    out["generated_tokens"] = outcome.result.generated_tokens;
+    out["tokens_saved"] = outcome.result.tokens_saved;
+    out["prompt_tokens"] = outcome.result.prompt_tokens;
+    out["prefill_us"] = outcome.result.prefill_us;
+    out["decode_us"] = outcome.result.decode_us;
+    if (outcome.cached) out["cached"] = true;
+    return out;
+}
+
+/// --batch holds at most this many results per in-flight request while
+/// waiting for an earlier, slower one to finish.
+constexpr size_t c_batch_reorder_factor = 8;
+
+/// Value at fraction `q` of `sorted`, or 0 if it is empty.
+double Percentile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0.0;
+    const size_t rank = static_cast<size_t>(q * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+/// --batch: run a JSONL file of requests through the queue and write the
+/// results in input order. Input is read only as fast as results drain, so
+/// at most `reorder_window` lines are held in memory however large the file
+/// is. Each input line is an object like a /chat_batch item; an "id" field
+/// is copied to the result. Ends with a throughput/latency summary on
+/// stderr. Returns the process exit code.
+int RunBatchFile(InferenceQueue& queue, const ChatManager& manager, ResponseCache* cache,
+                 const std::string& in_path, const std::string& out_path,
+                 size_t max_in_flight, size_t reorder_window) {
+    using clock = std::chrono::steady_clock;
+
+    std::ifstream in_file;
+    if (in_path != "-") {
+        in_file.open(in_path);
+        if (!in_file) {
+            std::cerr << "Failed to open batch input: " << in_path << "\n";
+            return 1;
+        }
+    }
+    std::istream& in = in_path == "-" ? std::cin : in_file;
+    std::ofstream out_file;
+    if (out_path != "-") {
+        out_file.open(out_path, std::ios::trunc);
+        if (!out_file) {
+            std::cerr << "Failed to open batch output: " << out_path << "\n";
+            return 1;
+        }
+    }
+    std::ostream& out = out_path == "-" ? std::cout : out_file;
+
+    const clock::time_point start = clock::now();
+    BatchRunner runner(queue, cache, max_in_flight);
+    std::map<size_t, std::string> ids;           // "id" of read lines not yet written
+    std::map<size_t, BatchOutcome> finished;     // completed out of order
+    std::optional<BatchItem> next_item;          // read but not yet admitted
+    size_t read = 0;
+    size_t written = 0;
+    bool eof = false;
+
+    std::vector<double> latencies;
+    std::vector<double> ttfts;
+    size_t errors = 0;
+    size_t generated_tokens = 0;
+
+    while (!eof || next_item || written < read) {
+        // Read ahead while the reorder window has room.
+        while (!next_item && !eof && read - written < reorder_window) {
+            std::string line;
+            if (!std::getline(in, line)) {
+                eof = true;
+                break;
+            }
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+            BatchItem item;
+            item.index = read++;
+            std::string error;
+            try {
+                const json body = json::parse(line);
+                if (body.is_object() && body.contains("id")) {
+                    ids[item.index] = body["id"].is_string() ? body["id"].get<std::string>()
+                                                             : body["id"].dump();
+                }
+                if (ParseBatchItem(body, item, error) && UseResponseCache(cache, body, item.params)) {
+                    item.cache_key = make_request_key(manager.model_type(), item.sys_prompt,
+                                                      item.user_prompt, item.params);
+                }
+            } catch (const json::parse_error& e) {
+                error = std::string("JSON parse error: ") + e.what();
+            } catch (const json::exception& e) {
+                // A bad line is that line's error, never the whole run's
+                error = std::string("Invalid item: ") + e.what();
+            }
+            if (!error.empty()) {
+                BatchOutcome outcome;
+                outcome.index = item.index;
+                outcome.error = std::move(error);
+                finished.emplace(item.index, std::move(outcome));
+                continue;
+            }
+            next_item = std::move(item);
+        }
+
+        if (next_item && runner.try_start(*next_item)) {
+            next_item.reset();
+            continue;
+        }
+
+        if (runner.in_flight() > 0) {
+            if (auto outcome = runner.next(c_batch_poll_interval)) {
+                if (outcome->error.empty()) {
+                    latencies.push_back(outcome->latency_s);
+                    if (!outcome->cached) ttfts.push_back(outcome->ttft_s);
+                    generated_tokens += outcome->result.generated_tokens;
+                }
+                finished.emplace(outcome->index, std::move(*outcome));
+            }
+        }
+
+        // Write everything that is now contiguous with the output.
+        for (auto it = finished.begin(); it != finished.end() && it->first == written;
+             it = finished.erase(it), ++written) {
+            json line = BatchOutcomeJson(it->second);
+            const auto id = ids.find(written);
+            if (id != ids.end()) {
+                line["id"] = id->second;
+                ids.erase(id);
+            }
+            if (!it->second.error.empty()) ++errors;
+            out << line.dump(-1, ' ', false, json::error_handler_t::replace) << '\n';
+        }
+    }
+    out.flush();
+
+    const double wall_s = std::chrono::duration<double>(clock::now() - start).count();
+    std::sort(latencies.begin(), latencies.end());
+    std::sort(ttfts.begin(), ttfts.end());
+    std::cerr << "Batch: " << written << " requests (" << errors << " failed) in "
+              << wall_s << " s on " << manager.pool_size() << " dialog handles\n"
+              << "  throughput: " << (wall_s > 0.0 ? static_cast<double>(written) / wall_s : 0.0)
+              << " req/s, " << (wall_s > 0.0 ? static_cast<double>(generated_tokens) / wall_s : 0.0)
+              << " generated tok/s\n"
+              << "  latency s: p50 " << Percentile(latencies, 0.50)
+              << "  p90 " << Percentile(latencies, 0.90)
+              << "  p99 " << Percentile(latencies, 0.99)
+              << "  max " << (latencies.empty() ? 0.0 : latencies.back()) << "\n"
+              << "  ttft s:    p50 " << Percentile(ttfts, 0.50)
+              << "  p90 " << Percentile(ttfts, 0.90)
+              << "  p99 " << Percentile(ttfts, 0.99) << "\n";
+    return out ? 0 : 1;
+}
+
+/// Framing used by a streaming endpoint.
+enum class StreamFormat {
+    PlainText,   ///< /chat_stream
+    EventStream  ///< /chat_events
+};
+
+/// Read the optional "extract" field of a streaming request: one key or
+/// a list of up to 64 keys whose string values are streamed instead of
+/// the raw model text. Returns false and fills `error` if it is invalid.
+bool ParseExtractKeys(const json& body, StreamFormat format,
+                      std::vector<std::string>& keys, std::string& error) {
+    if (!body.contains("extract")) return true;
+    try {
+        const auto& v = body["extract"];
+        if (v.is_string()) {
+            keys.push_back(v.get<std::string>());
+        } else {
+            keys = v.get<std::vector<std::string>>();
+        }
+    } catch (const json::exception& e) {
+        error = std::string("extract must be a key or a list of keys: ") + e.what();
+        return false;
+    }
+    if (format != StreamFormat::PlainText) {
+        error = "extract is only supported on /chat_stream";
+        return false;
+    }
+    if (keys.empty() || keys.size() > JsonFieldExtractor::c_max_keys) {
+        error = "extract must list between 1 and 64 keys";
+        return false;
+    }
+    return true;
+}
+
+/// Encoder for a streaming response. On /chat_stream a binary Accept
+/// selects msgpack/CBOR event frames; "extract" keeps its NDJSON.
+std::shared_ptr<StreamEncoder> MakeStreamEncoder(const httplib::Request& req, StreamFormat format,
+                                                 std::vector<std::string> extract_keys,
+                                                 std::chrono::steady_clock::time_point request_start) {
+    if (format == StreamFormat::EventStream) {
+        return std::make_shared<EventStreamEncoder>(request_start);
+    }
+    if (!extract_keys.empty()) {
+        return std::make_shared<FieldExtractEncoder>(std::move(extract_keys));
+    }
+    if (const auto binary = binary_format_from_accept(req.get_header_value("Accept"))) {
+        return std::make_shared<EventStreamEncoder>(request_start, binary);
+    }
+    return std::make_shared<PlainTextEncoder>();
+}
+
+/// Routes counted under their own label in chatapp_http_requests_total
+/// and used as the name of a request's root trace span.
+constexpr const char* c_metrics_endpoints[] = {
+    "/hi", "/metrics", "/chat", "/chat_stream", "/chat_events", "/chat_batch", "/jobs", "/jobs/{id}",
+    "/debug/trace"};
+
+/// Label under which a request path is counted; job ids are folded so
+/// the label set stays bounded. Unknown paths are "other".
+const char* MetricsEndpoint(const std::string& path) {
+    constexpr std::string_view jobs = "/jobs/";
+    if (path.compare(0, jobs.size(), jobs) == 0) return "/jobs/{id}";
+    for (const char* endpoint : c_metrics_endpoints) {
+        if (path == endpoint) return endpoint;
+    }
+    return "other";
+}
+
+/// Value of the X-Request-Id response header.
+std::string RequestIdHeader(uint64_t request_id) {
+    char id[20];
+    std::snprintf(id, sizeof(id), "%llx", static_cast<unsigned long long>(request_id));
+    return id;
+}
+
+/// Counts one request as in flight from construction until destruction,
+/// then records its endpoint and final status, and its root trace span
+/// if the request is sampled.
+class RequestScope {
+public:
+    RequestScope(ServerMetrics& metrics, const std::string& path, uint64_t request_id)
+        : m_metrics(metrics), m_endpoint(MetricsEndpoint(path)),
+          m_trace_request(Tracer::instance().sampled(request_id) ? request_id : 0),
+          m_start(m_trace_request ? Tracer::Clock::now() : Tracer::Clock::time_point{}) {
+        m_metrics.in_flight_requests.fetch_add(1, std::memory_order_relaxed);
+    }
+    RequestScope(const RequestScope&) = delete;
+    RequestScope& operator=(const RequestScope&) = delete;
+    ~RequestScope() {
+        m_metrics.requests.record(m_endpoint, m_status);
+        m_metrics.in_flight_requests.fetch_sub(1, std::memory_order_relaxed);
+        if (m_trace_request) {
+            Tracer::instance().record(m_endpoint, m_trace_request, m_start, Tracer::Clock::now());
+        }
+    }
+
+    void set_status(int status) { m_status = status; }
+
+private:
+    ServerMetrics& m_metrics;
+    const char* m_endpoint;
+    int m_status = 0;
+    uint64_t m_trace_request;
+    Tracer::Clock::time_point m_start;
+};
+
+/// httplib routes, answers and logs a request on one thread, so the
+/// scopes opened by the pre-routing handler are closed by the logger.
+thread_local std::optional<RequestScope> t_request_scope;
+thread_local std::optional<TraceScope> t_trace_scope;
+
+void RejectBusy(httplib::Response& res, unsigned retry_after_s) {
+    res.status = 503;
+    res.set_header("Retry-After", std::to_string(retry_after_s));
+    res.set_content("Error: server busy, retry later", "text/plain");
 }
 } // namespace
 
 int main(int argc, char* argv[]) {
     std::string genie_config_path;
     std::string base_dir;
+#ifdef CHATAPP_WITH_GENIE
+    std::string backend_name = "genie";
+#else
+    std::string backend_name = "standin";
+#endif
+    StandInConfig standin_config;
+    size_t dialog_count = 1;
+    size_t prefix_cache_mb = 0;
+    size_t response_cache_mb = 0;
+    std::chrono::seconds response_cache_ttl{300};
+    StreamFlushPolicy flush_policy;
+    TokenRingConfig ring_config;
+    JobStoreConfig job_config;
+    InferenceQueueConfig queue_config;
+    size_t batch_concurrency = 0; // 0 = derive from dialog_count
+    size_t job_max_in_queue = 0;  // 0 = derive from queue_config.max_depth
+    LoggerConfig log_config;
+    TracerConfig trace_config;
+    std::string listen_host = "0.0.0.0";
+    int listen_port = 8080;
+    std::string unix_socket_path;
+    std::filesystem::perms unix_socket_mode = static_cast<std::filesystem::perms>(0660);
+    int event_loop_port = 0;
+    EventLoopConfig event_loop_config;
+    std::string batch_in;
+    std::string batch_out = "-";
 
     // Parse CLI args
     for (int i = 1; i < argc; ++i) {
@@ -36,53 +816,268 @@ int main(int argc, char* argv[]) {
             genie_config_path = argv[++i];
         } else if (c_option_base_dir == argv[i] && i + 1 < argc) {
             base_dir = argv[++i];
+        } else if (c_option_backend == argv[i] && i + 1 < argc) {
+            backend_name = argv[++i];
+        } else if (c_option_dialogs == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_dialogs, argv[++i], dialog_count)) return 1;
+        } else if (c_option_queue_depth == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_queue_depth, argv[++i], queue_config.max_depth)) return 1;
+        } else if (c_option_queue_wait == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_queue_wait, argv[++i], queue_config.max_wait)) return 1;
+        } else if (c_option_schedule == argv[i] && i + 1 < argc) {
+            const std::string_view policy = argv[++i];
+            if (policy == "fifo") {
+                queue_config.policy = SchedulingPolicy::Fifo;
+            } else if (policy == "sjf") {
+                queue_config.policy = SchedulingPolicy::ShortestJobFirst;
+            } else {
+                std::cerr << "Unknown schedule: " << policy << "\n";
+                return 1;
+            }
+        } else if (c_option_sjf_aging == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_sjf_aging, argv[++i], queue_config.sjf_aging)) return 1;
+        } else if (c_option_prefix_cache == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_prefix_cache, argv[++i], prefix_cache_mb)) return 1;
+        } else if (c_option_response_cache == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_response_cache, argv[++i], response_cache_mb)) return 1;
+        } else if (c_option_response_ttl == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_response_ttl, argv[++i], response_cache_ttl)) return 1;
+        } else if (c_option_flush_ms == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_flush_ms, argv[++i], flush_policy.interval)) return 1;
+        } else if (c_option_flush_bytes == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_flush_bytes, argv[++i], flush_policy.max_bytes)) return 1;
+        } else if (c_option_ring_kb == argv[i] && i + 1 < argc) {
+            size_t kib = 0;
+            if (!ParseOptionValue(c_option_ring_kb, argv[++i], kib)) return 1;
+            ring_config.capacity_bytes = kib << 10;
+        } else if (c_option_overflow == argv[i] && i + 1 < argc) {
+            const std::string_view policy = argv[++i];
+            if (policy == "spill") {
+                ring_config.overflow = RingOverflowPolicy::Spill;
+            } else if (policy == "cancel") {
+                ring_config.overflow = RingOverflowPolicy::Cancel;
+            } else {
+                std::cerr << "Unknown stream overflow policy: " << policy << "\n";
+                return 1;
+            }
+        } else if (c_option_job_backlog == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_job_backlog, argv[++i], job_config.max_backlog)) return 1;
+        } else if (c_option_job_ttl == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_job_ttl, argv[++i], job_config.ttl)) return 1;
+        } else if (c_option_job_in_queue == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_job_in_queue, argv[++i], job_max_in_queue)) return 1;
+        } else if (c_option_log_level == argv[i] && i + 1 < argc) {
+            const auto level = parse_log_level(argv[++i]);
+            if (!level) {
+                std::cerr << "Unknown log level: " << argv[i] << "\n";
+                return 1;
+            }
+            log_config.level = *level;
+        } else if (c_option_log_prompts == argv[i] && i + 1 < argc) {
+            const std::string_view mode = argv[++i];
+            if (mode == "full") {
+                log_config.prompt_mode = PromptLogMode::Full;
+            } else if (mode == "truncate") {
+                log_config.prompt_mode = PromptLogMode::Truncate;
+            } else if (mode == "hash") {
+                log_config.prompt_mode = PromptLogMode::Hash;
+            } else {
+                std::cerr << "Unknown prompt log mode: " << mode << "\n";
+                return 1;
+            }
+        } else if (c_option_log_prompt_bytes == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_log_prompt_bytes, argv[++i], log_config.prompt_max_bytes)) return 1;
+        } else if (c_option_trace_rate == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_trace_rate, argv[++i], trace_config.sample_rate)) return 1;
+        } else if (c_option_trace_spans == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_trace_spans, argv[++i], trace_config.thread_buffer_spans)) return 1;
+        } else if (c_option_host == argv[i] && i + 1 < argc) {
+            listen_host = argv[++i];
+        } else if (c_option_port == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_port, argv[++i], listen_port)) return 1;
+        } else if (c_option_unix_socket == argv[i] && i + 1 < argc) {
+            unix_socket_path = argv[++i];
+        } else if (c_option_unix_mode == argv[i] && i + 1 < argc) {
+            unsigned mode = 0;
+            if (!ParseOptionValue(c_option_unix_mode, argv[++i], mode, 8)) return 1;
+            unix_socket_mode = static_cast<std::filesystem::perms>(mode);
+        } else if (c_option_event_port == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_event_port, argv[++i], event_loop_port)) return 1;
+        } else if (c_option_event_threads == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_event_threads, argv[++i], event_loop_config.threads)) return 1;
+        } else if (c_option_batch_in == argv[i] && i + 1 < argc) {
+            batch_in = argv[++i];
+        } else if (c_option_batch_out == argv[i] && i + 1 < argc) {
+            batch_out = argv[++i];
+        } else if (c_option_batch_concurrency == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_batch_concurrency, argv[++i], batch_concurrency)) return 1;
+        } else if (c_option_prefill_rate == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_prefill_rate, argv[++i], standin_config.prefill_tok_per_s)) return 1;
+        } else if (c_option_decode_rate == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_decode_rate, argv[++i], standin_config.decode_tok_per_s)) return 1;
+        } else if (c_option_reply_tokens == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_reply_tokens, argv[++i], standin_config.reply_tokens)) return 1;
+        } else if (c_option_trailing_tokens == argv[i] && i + 1 < argc) {
+            if (!ParseOptionValue(c_option_trailing_tokens, argv[++i], standin_config.trailing_tokens)) return 1;
         } else if (c_option_help == argv[i] || c_option_help_short == argv[i]) {
             PrintHelp(argv[0]);
             return 0;
         }
     }
 
-    if (genie_config_path.empty() || base_dir.empty()) {
+    // Request-path logging goes through per-thread rings to a writer thread
+    Logger::instance().start(log_config);
+    Tracer::instance().configure(trace_config);
+
+    std::unique_ptr<InferenceBackend> backend;
+    if (backend_name == "standin") {
+        backend = std::make_unique<StandInBackend>(standin_config);
+    } else if (backend_name == "genie") {
+#ifdef CHATAPP_WITH_GENIE
+        if (genie_config_path.empty() || base_dir.empty()) {
+            PrintHelp(argv[0]);
+            return 1;
+        }
+
+        // Validate paths
+        if (!std::filesystem::exists(genie_config_path)) {
+            std::cerr << "Config file not found: " << genie_config_path << "\n";
+            return 1;
+        }
+        if (!std::filesystem::exists(base_dir)) {
+            std::cerr << "Base dir not found: " << base_dir << "\n";
+            return 1;
+        }
+
+        // Load config file into string
+        std::ifstream config_file(genie_config_path);
+        if (!config_file) {
+            std::cerr << "Failed to open Genie config file: " << genie_config_path << "\n";
+            return 1;
+        }
+        std::string config((std::istreambuf_iterator<char>(config_file)),
+                           std::istreambuf_iterator<char>());
+
+        // Set working dir
+        std::filesystem::current_path(base_dir);
+
+        backend = std::make_unique<GenieBackend>(config);
+#else
+        std::cerr << "This build has no Genie support (QNN_SDK_ROOT was not set at configure time)\n";
+        return 1;
+#endif
+    } else {
+        std::cerr << "Unknown backend: " << backend_name << "\n";
         PrintHelp(argv[0]);
         return 1;
     }
 
-    // Validate paths
-    if (!std::filesystem::exists(genie_config_path)) {
-        std::cerr << "Config file not found: " << genie_config_path << "\n";
+    if (listen_port == 0 && unix_socket_path.empty() && batch_in.empty()) {
+        std::cerr << c_option_port << " 0 needs " << c_option_unix_socket << "\n";
         return 1;
     }
-    if (!std::filesystem::exists(base_dir)) {
-        std::cerr << "Base dir not found: " << base_dir << "\n";
+
+    if (dialog_count == 0) {
+        std::cerr << c_option_dialogs << " must be at least 1\n";
         return 1;
     }
 
-    // Load config file into string
-    std::ifstream config_file(genie_config_path);
-    if (!config_file) {
-        std::cerr << "Failed to open Genie config file: " << genie_config_path << "\n";
-        return 1;
+    if (batch_concurrency == 0) {
+        batch_concurrency = std::max<size_t>(1, dialog_count / 2);
     }
-    std::string config((std::istreambuf_iterator<char>(config_file)),
-                       std::istreambuf_iterator<char>());
+    job_config.max_in_queue = job_max_in_queue != 0 ? job_max_in_queue
+                                                    : std::max<size_t>(1, queue_config.max_depth / 4);
 
-    // Set working dir
-    std::filesystem::current_path(base_dir);
+    // Lock-free counters and histograms, updated on the request path
+    ServerMetrics metrics;
+    for (const char* endpoint : c_metrics_endpoints) {
+        metrics.requests.add_endpoint(endpoint);
+    }
 
-    // Init ChatManager (non–thread-safe)
-    ChatManager manager(config);
+    // Init ChatManager with a pool of stateless dialogues; each request
+    // checks one out, so up to dialog_count generations run concurrently.
+    ChatManager manager(std::move(backend));
+    manager.set_metrics(&metrics);
+    manager.create_dialogue_pool(dialog_count);
+    if (prefix_cache_mb > 0) {
+        manager.enable_prefix_cache(prefix_cache_mb << 20);
+    }
+    // In batch mode stdout may carry the results.
+    (batch_in.empty() ? std::cout : std::cerr)
+        << "Inference backend: " << manager.backend_name()
+        << " (" << manager.pool_size() << " dialog handles)\n";
 
-    // Reuse a single dialogue id if that's what you want
-    std::string dlg = manager.create_new_dialogue(false);
+    // All generations go through the bounded queue; overload is shed with 503.
+    if (backend_name == "standin") {
+        queue_config.initial_decode_tok_per_s = standin_config.decode_tok_per_s;
+        queue_config.initial_prefill_tok_per_s = standin_config.prefill_tok_per_s;
+    }
+    // Batch mode keeps one job queued behind every running one so no
+    // dialog handle idles between requests.
+    const size_t batch_file_in_flight = 2 * manager.pool_size();
+    if (!batch_in.empty()) {
+        queue_config.max_depth = std::max(queue_config.max_depth, batch_file_in_flight);
+    }
+    InferenceQueue queue(manager, queue_config);
+    queue.set_metrics(&metrics);
 
-    // Serialize ALL access to ChatManager
-    static std::mutex g_mgr_mu;
+    // Identical deterministic requests are answered without touching the queue.
+    std::unique_ptr<ResponseCache> response_cache;
+    if (response_cache_mb > 0) {
+        response_cache = std::make_unique<ResponseCache>(response_cache_mb << 20, response_cache_ttl);
+    }
 
-    httplib::Server svr;
+    if (!batch_in.empty()) {
+        return RunBatchFile(queue, manager, response_cache.get(), batch_in, batch_out,
+                            batch_file_in_flight, c_batch_reorder_factor * batch_file_in_flight);
+    }
+
+    // Identical requests arriving while one is generating share its output.
+    SingleFlight single_flight;
+
+    // POST /jobs: accepted requests wait in memory, not on an HTTP thread.
+    JobStore jobs(queue, response_cache.get(), job_config);
+
+    // Event loop jobs still waiting in the queue. Nothing blocks on them,
+    // so the loop's tick sheds the ones that outstay max_wait.
+    struct QueuedExchange {
+        InferenceQueue::PendingJob pending;
+        std::weak_ptr<EventLoopServer::Exchange> exchange;
+        std::shared_ptr<std::atomic<bool>> cancel;
+    };
+    std::mutex queued_exchanges_mu;
+    std::vector<QueuedExchange> queued_exchanges;
+
+    // Optional epoll front end, started once the routes below exist
+    std::unique_ptr<EventLoopServer> event_server;
+
+    // Every route below is served on each listener
+    ServerGroup svr;
+    httplib::Server* tcp_server = listen_port > 0 ? &svr.add() : nullptr;
+    httplib::Server* unix_server = unix_socket_path.empty() ? nullptr : &svr.add();
 
     // Avoid huge POST bodies nuking memory
     svr.set_payload_max_length(1ULL << 20); // 1 MiB
 
+    // Requests are in flight from routing until their last byte is written
+    // and are traced under the id echoed in X-Request-Id
+    svr.set_pre_routing_handler([&](const httplib::Request& req, httplib::Response& res) {
+        const uint64_t request_id = Tracer::instance().next_request_id();
+        res.set_header("X-Request-Id", RequestIdHeader(request_id));
+        t_request_scope.emplace(metrics, req.path, request_id);
+        t_trace_scope.emplace(request_id);
+        return httplib::Server::HandlerResponse::Unhandled;
+    });
+    svr.set_logger([&](const httplib::Request& req, const httplib::Response& res) {
+        if (t_request_scope) {
+            t_request_scope->set_status(res.status);
+            t_request_scope.reset();
+            t_trace_scope.reset();
+        } else {
+            metrics.requests.record(MetricsEndpoint(req.path), res.status); // rejected before routing
+        }
+    });
+
     // Better top-level error visibility
     svr.set_exception_handler([](const httplib::Request&, httplib::Response& res, std::exception_ptr ep) {
         try { if (ep) std::rethrow_exception(ep); }
@@ -101,39 +1096,120 @@ int main(int argc, char* argv[]) {
         res.set_content("Hello from Chat server!", "text/plain");
     });
 
+    // Prometheus scrape endpoint
+    svr.Get("/metrics", [&](const httplib::Request &, httplib::Response &res) {
+        std::string out = metrics.render();
+        append_metric(out, "chatapp_jobs_backlog", "gauge",
+                      "Async jobs accepted but not yet handed to the inference queue.",
+                      static_cast<double>(jobs.backlog()));
+        append_metric(out, "chatapp_log_dropped_total", "counter",
+                      "Log records dropped because a thread's log buffer was full.",
+                      static_cast<double>(Logger::instance().dropped()));
+        append_metric(out, "chatapp_coalesced_requests_total", "counter",
+                      "Requests served by attaching to an identical in-flight generation.",
+                      static_cast<double>(single_flight.coalesced()));
+        if (event_server) {
+            append_metric(out, "chatapp_event_loop_connections", "gauge",
+                          "Client connections open on the event loop front end.",
+                          static_cast<double>(event_server->connections()));
+        }
+        if (const PrefixCache* cache = manager.prefix_cache()) {
+            const auto stats = cache->stats();
+            append_metric(out, "chatapp_prefix_cache_hits_total", "counter",
+                          "System-prompt prefix cache hits.", static_cast<double>(stats.hits));
+            append_metric(out, "chatapp_prefix_cache_misses_total", "counter",
+                          "System-prompt prefix cache misses.", static_cast<double>(stats.misses));
+            const uint64_t lookups = stats.hits + stats.misses;
+            append_metric(out, "chatapp_prefix_cache_hit_ratio", "gauge",
+                          "Prefix cache hits / lookups since start.",
+                          lookups ? static_cast<double>(stats.hits) / static_cast<double>(lookups) : 0.0);
+            append_metric(out, "chatapp_prefix_cache_evictions_total", "counter",
+                          "Prefix snapshots evicted to stay under budget.", static_cast<double>(stats.evictions));
+            append_metric(out, "chatapp_prefix_cache_bytes", "gauge",
+                          "Bytes held by cached prefix snapshots.", static_cast<double>(stats.bytes));
+        }
+        if (response_cache) {
+            const auto stats = response_cache->stats();
+            const uint64_t lookups = stats.hits + stats.misses;
+            append_metric(out, "chatapp_response_cache_hits_total", "counter",
+                          "Requests answered from the response cache.", static_cast<double>(stats.hits));
+            append_metric(out, "chatapp_response_cache_misses_total", "counter",
+                          "Cacheable requests that had to be generated.", static_cast<double>(stats.misses));
+            append_metric(out, "chatapp_response_cache_hit_ratio", "gauge",
+                          "Response cache hits / lookups since start.",
+                          lookups ? static_cast<double>(stats.hits) / static_cast<double>(lookups) : 0.0);
+            append_metric(out, "chatapp_response_cache_evictions_total", "counter",
+                          "Responses evicted to stay under budget.", static_cast<double>(stats.evictions));
+            append_metric(out, "chatapp_response_cache_entries", "gauge",
+                          "Responses held in the cache.", static_cast<double>(stats.entries));
+            append_metric(out, "chatapp_response_cache_bytes", "gauge",
+                          "Bytes held by cached responses.", static_cast<double>(stats.bytes));
+        }
+        res.set_content(out, "text/plain; version=0.0.4");
+    });
+
+    // Recent spans of sampled requests as Chrome trace-event JSON (open in
+    // Perfetto); ?clear=1 empties the buffers
+    svr.Get("/debug/trace", [&](const httplib::Request& req, httplib::Response& res) {
+        res.set_content(Tracer::instance().chrome_json(req.get_param_value("clear") == "1"),
+                        "application/json");
+    });
+
     // Blocking endpoint: receive JSON, send text
     svr.Post("/chat", [&](const httplib::Request& req, httplib::Response& res) {
+        const auto request_start = std::chrono::steady_clock::now();
         try {
-            json body;
-            try {
-                body = json::parse(req.body);
-            } catch (const json::parse_error& e) {
-                res.status = 400;
-                res.set_content(std::string("JSON parse error: ") + e.what(), "text/plain");
-                return;
-            }
-
-            std::string sys_prompt = body.value("sys_prompt", "");
-            std::string user_prompt = body.value("user_prompt", "");
-            std::cerr << "[DEBUG] sys_prompt: " << sys_prompt << "\n";
-            std::cerr << "[DEBUG] user_prompt: " << user_prompt << "\n";
+            ChatRequest chat;
+            if (!ParseChatRequest(req, res, chat)) return;
+            const json& body = chat.body;
+            const std::string& sys_prompt = chat.sys_prompt;
+            const std::string& user_prompt = chat.user_prompt;
+            const GenerationParams& params = chat.params;
 
+            const RequestKey request_key =
+                make_request_key(manager.model_type(), sys_prompt, user_prompt, params);
+            const bool cacheable = UseResponseCache(response_cache.get(), body, params);
+            if (cacheable) {
+                CHATAPP_TRACE_SPAN("response_cache_lookup");
+                if (auto hit = response_cache->lookup(request_key)) {
+                    res.set_header("X-Cache", "hit");
+                    SetChatContent(req, res, hit->text(), hit->result(), request_start);
+                    return;
+                }
+            }
 
-            if (sys_prompt.empty() || user_prompt.empty()) {
-                res.status = 400;
-                res.set_content("Error: sys_prompt and user_prompt required", "text/plain");
+            auto ticket = single_flight.join(request_key);
+            auto slot = ticket.leader ? queue.try_admit() : std::optional<InferenceQueue::Slot>{};
+            if (ticket.leader && !slot) {
+                single_flight.complete(request_key, ticket.generation,
+                                       std::make_exception_ptr(QueueWaitTimeout()));
+                RejectBusy(res, queue.retry_after_seconds());
                 return;
             }
 
             std::string output;
+            GenerationResult result;
+            ResponseCache::Recorder recorder;
             try {
-                std::lock_guard<std::mutex> lk(g_mgr_mu);  // serialize ChatManager access
-                
-                std::cerr << "[DEBUG] manager.query starting\n";
-                manager.query(dlg, sys_prompt, user_prompt,
-                              [&](const char* text, GenieDialog_SentenceCode_t) {
-                                  output += text;
-                              });
+                if (!ticket.leader) {
+                    result = ticket.generation->wait(output);
+                } else {
+                    CHATAPP_LOG(LogLevel::Debug, "/chat generation starting");
+                    InferenceJob job;
+                    job.sys_prompt = sys_prompt;
+                    job.user_prompt = user_prompt;
+                    job.callback = [&](const char* text, SentenceCode) {
+                        output += text;
+                        if (cacheable) recorder.record(text);
+                    };
+                    job.params = params;
+                    result = RunLeader(queue, single_flight, request_key, ticket.generation,
+                                       std::move(*slot), std::move(job));
+                    if (cacheable) response_cache->insert(request_key, recorder.finish(result));
+                }
+            } catch (const QueueWaitTimeout&) {
+                RejectBusy(res, queue.retry_after_seconds());
+                return;
             } catch (const std::bad_alloc&) {
                 res.status = 500;
                 res.set_content("Error: out of memory (bad_alloc) in manager.query", "text/plain");
@@ -143,85 +1219,623 @@ int main(int argc, char* argv[]) {
                 res.set_content(std::string("Error in manager.query: ") + e.what(), "text/plain");
                 return;
             }
-            std::cerr << "[DEBUG] output " << output << "\n";
+            CHATAPP_LOG(LogLevel::Debug, "/chat output: " << Logger::instance().prompt(output));
 
-
-            res.set_content(output, "text/plain");
+            if (cacheable) res.set_header("X-Cache", "miss");
+            SetChatContent(req, res, output, result, request_start);
         } catch (const std::exception& e) {
             res.status = 500;
             res.set_content(std::string("Error: ") + e.what(), "text/plain");
         }
     });
 
-    // Streaming endpoint: receive JSON, stream plain text
-    svr.Post("/chat_stream", [&](const httplib::Request& req, httplib::Response& res) {
+    // Streaming endpoints: receive JSON, stream the generation framed by
+    // the encoder for `format`
+    auto handle_stream = [&](const httplib::Request& req, httplib::Response& res, StreamFormat format) {
+        const auto request_start = std::chrono::steady_clock::now();
         try {
-            std::cerr << "[DEBUG] POST /chat_stream called\n";
-            std::cerr << "[DEBUG] Raw body: " << req.body << "\n";
-            json body;
-            try {
-                body = json::parse(req.body);
-                std::cerr << "[DEBUG] Parsed JSON\n";
-            } catch (const json::parse_error& e) {
-                std::cerr << "[DEBUG] JSON parse error: " << e.what() << "\n";
+            CHATAPP_LOG(LogLevel::Debug, "POST " << req.path << " body: " << Logger::instance().prompt(req.body));
+            ChatRequest chat;
+            if (!ParseChatRequest(req, res, chat)) return;
+            const json& body = chat.body;
+            std::string sys_prompt = std::move(chat.sys_prompt);
+            std::string user_prompt = std::move(chat.user_prompt);
+            GenerationParams params = std::move(chat.params);
+
+            // Optional server-side extraction of string fields from the model's JSON
+            std::vector<std::string> extract_keys;
+            std::string extract_error;
+            if (!ParseExtractKeys(body, format, extract_keys, extract_error)) {
                 res.status = 400;
-                res.set_content(std::string("JSON parse error: ") + e.what(), "text/plain");
+                res.set_content("Error: " + extract_error, "text/plain");
                 return;
             }
 
-            std::string sys_prompt = body.value("sys_prompt", "");
-            std::string user_prompt = body.value("user_prompt", "");
-            std::cerr << "[DEBUG] sys_prompt: " << sys_prompt << "\n";
-            std::cerr << "[DEBUG] user_prompt: " << user_prompt << "\n";
-            
-            
-            if (sys_prompt.empty() || user_prompt.empty()) {
-                res.status = 400;
-                res.set_content("Error: sys_prompt and user_prompt required", "text/plain");
-                return;
+            // A cache hit replays the recorded chunks through the same
+            // chunked path as a live generation, without taking a slot.
+            const RequestKey request_key =
+                make_request_key(manager.model_type(), sys_prompt, user_prompt, params);
+            const bool cacheable = UseResponseCache(response_cache.get(), body, params);
+            std::shared_ptr<const ResponseCache::Entry> hit;
+            if (cacheable) {
+                CHATAPP_TRACE_SPAN("response_cache_lookup");
+                hit = response_cache->lookup(request_key);
+                res.set_header("X-Cache", hit ? "hit" : "miss");
             }
 
+            // Duplicates of a running request follow it instead of queueing
+            SingleFlight::Ticket ticket;
+            std::shared_ptr<InferenceQueue::Slot> slot;
+            if (!hit) {
+                ticket = single_flight.join(request_key);
+            }
+
+            // Admit before committing to a 200 so overload can still be shed
+            if (ticket.leader) {
+                auto admitted = queue.try_admit();
+                if (!admitted) {
+                    single_flight.complete(request_key, ticket.generation,
+                                           std::make_exception_ptr(QueueWaitTimeout()));
+                    RejectBusy(res, queue.retry_after_seconds());
+                    return;
+                }
+                slot = std::make_shared<InferenceQueue::Slot>(std::move(*admitted));
+            }
+
+            const std::shared_ptr<StreamEncoder> encoder =
+                MakeStreamEncoder(req, format, std::move(extract_keys), request_start);
+            if (format == StreamFormat::EventStream) {
+                res.set_header("Cache-Control", "no-cache");
+            }
+
+            // httplib skips the provider when the client is gone before the
+            // first write; the releaser then settles our part in the flight.
+            auto provider_ran = std::make_shared<std::atomic<bool>>(false);
+
             // Capture prompts by value so nothing dangles
             res.set_chunked_content_provider(
-                "text/plain",
-                [&, sys_prompt = std::move(sys_prompt), user_prompt = std::move(user_prompt)]
+                encoder->content_type(),
+                [&, slot, hit, ticket, request_key, cacheable, encoder, provider_ran, params = std::move(params), sys_prompt = std::move(sys_prompt), user_prompt = std::move(user_prompt)]
                 (size_t /*offset*/, httplib::DataSink& sink) {
+                    provider_ran->store(true, std::memory_order_relaxed);
+                    GenerationResult result;
+                    std::atomic<bool> client_gone{false};
+                    ResponseCache::Recorder recorder;
+                    FrameBuffer frame(flush_policy); // reused for every write of this response
+
+                    auto write_frame = [&] {
+                        CHATAPP_TRACE_SPAN("socket_write");
+                        const std::string& data = frame.data();
+                        const bool ok = sink.is_writable() &&
+                                        (data.empty() || sink.write(data.data(), data.size()));
+                        frame.clear();
+                        return ok;
+                    };
+
+                    auto on_token = [&](const char* text, SentenceCode code) {
+                        if (client_gone.load(std::memory_order_relaxed)) return;
+
+                        const size_t n = std::strlen(text); // ChatManager must return NUL-terminated chunks
+                        encoder->encode_chunk(frame.data(), text, n, code);
+
+                        if (frame.due(code) && !write_frame()) {
+                            // Client disconnected: once nobody else follows this
+                            // generation it is aborted, freeing the dialog for others
+                            client_gone.store(true, std::memory_order_relaxed);
+                            if (ticket.generation) ticket.generation->detach();
+                        }
+                    };
+
+                    if (hit) {
+                        hit->replay(on_token);
+                        if (client_gone.load(std::memory_order_relaxed)) return false;
+                        encoder->encode_finish(frame.data(), hit->result());
+                        write_frame();
+                        sink.done_with_trailer(GenerationMetadata(hit->result()));
+                        return true;
+                    }
+
                     try {
-                        std::lock_guard<std::mutex> lk(g_mgr_mu); // serialize ChatManager access
-                        std::cerr << "[DEBUG] manager.query (streaming) starting\n";
-                        manager.query(
-                            dlg, sys_prompt, user_prompt,
-                            [&](const char* text, GenieDialog_SentenceCode_t code) {
-                                const size_t n = std::strlen(text); // ChatManager must return NUL-terminated chunks
-                                if (n) sink.write(text, n);
-                                std::cerr << "[DEBUG] Stream chunk: \"" << text << "\" (len=" << n << ", code=" << code << ")\n";
-                                
-                                if (code == GENIE_DIALOG_SENTENCE_END) {
-                                    sink.write("\n", 1); // separate responses
-                                }
-                            });
-                        
-                        std::cerr << "[DEBUG] manager.query (streaming) finished\n";
+                        if (!ticket.leader) {
+                            result = ticket.generation->follow(on_token, client_gone);
+                        } else {
+                            // The inference thread only fills the ring; this
+                            // thread does every socket write, so a slow client
+                            // never holds the dialog.
+                            CHATAPP_LOG(LogLevel::Debug, req.path << " generation starting");
+                            TokenRing ring(ring_config);
+                            InferenceJob job;
+                            job.sys_prompt = sys_prompt;
+                            job.user_prompt = user_prompt;
+                            job.callback = [&](const char* text, SentenceCode code) {
+                                if (cacheable) recorder.record(text);
+                                ring.push(text, code);
+                            };
+                            job.params = params;
+                            result = RunLeader(
+                                queue, single_flight, request_key, ticket.generation,
+                                std::move(*slot), std::move(job),
+                                [&](InferenceQueue::PendingJob& pending) {
+                                    while (!ring.ended() && !pending.poll()) {
+                                        ring.wait(c_ring_poll_interval);
+                                        ring.drain(on_token);
+                                        if (frame.overdue() && !client_gone.load(std::memory_order_relaxed) &&
+                                            !write_frame()) {
+                                            // Client disconnected, as in on_token
+                                            client_gone.store(true, std::memory_order_relaxed);
+                                            ticket.generation->detach();
+                                        }
+                                        if (ring.overflowed() && !client_gone.load(std::memory_order_relaxed)) {
+                                            // Too far behind: drop this client like a disconnect
+                                            metrics.stream_overflows.fetch_add(1, std::memory_order_relaxed);
+                                            client_gone.store(true, std::memory_order_relaxed);
+                                            ticket.generation->detach();
+                                        }
+                                    }
+                                    ring.drain(on_token);
+                                });
+                            if (cacheable) response_cache->insert(request_key, recorder.finish(result));
+                            CHATAPP_LOG(LogLevel::Debug, req.path << " generation finished: "
+                                        << to_string(result.finish_reason) << ", "
+                                        << result.generated_tokens << " tokens");
+                        }
+
+                        if (client_gone.load(std::memory_order_relaxed)) {
+                            if (ticket.leader && result.finish_reason == FinishReason::Aborted) {
+                                metrics.abandoned_generations.fetch_add(1, std::memory_order_relaxed);
+                                CHATAPP_LOG(LogLevel::Info, req.path << " client disconnected, generation abandoned after "
+                                            << result.generated_tokens << " tokens");
+                            }
+                            return false;
+                        }
+                        encoder->encode_finish(frame.data(), result);
+                    } catch (const QueueWaitTimeout& e) {
+                        encoder->encode_error(frame.data(), std::string("Error: ") + e.what());
                     } catch (const std::bad_alloc&) {
-                        const char* err = "Error: out of memory (bad_alloc) in manager.query\n";
-                        sink.write(err, std::strlen(err));
+                        encoder->encode_error(frame.data(), "Error: out of memory (bad_alloc) in manager.query");
                     } catch (const std::exception& e) {
-                        std::string err = std::string("Error in manager.query: ") + e.what() + "\n";
-                        sink.write(err.c_str(), err.size());
+                        encoder->encode_error(frame.data(), std::string("Error in manager.query: ") + e.what());
                     }
-                    sink.done(); // close exactly once, after query completes
+                    write_frame();
+                    sink.done_with_trailer(GenerationMetadata(result)); // close exactly once, after query completes
                     return true;
+                },
+                [&single_flight, ticket, request_key, provider_ran](bool /*success*/) {
+                    if (provider_ran->load(std::memory_order_relaxed) || !ticket.generation) return;
+                    if (ticket.leader) {
+                        // Nothing was queued; the slot goes back with the lambda.
+                        // Followers that joined meanwhile see an aborted generation.
+                        GenerationResult aborted;
+                        aborted.finish_reason = FinishReason::Aborted;
+                        single_flight.complete(request_key, ticket.generation, aborted);
+                    } else {
+                        ticket.generation->detach();
+                    }
                 });
         } catch (const std::exception& e) {
             res.status = 500;
             res.set_content(std::string("Error: ") + e.what(), "text/plain");
         }
+    };
+
+    // Raw model text over chunked transfer encoding, "\n" after each response
+    svr.Post("/chat_stream", [&](const httplib::Request& req, httplib::Response& res) {
+        handle_stream(req, res, StreamFormat::PlainText);
+    });
+
+    // Server-Sent Events: one event per token batch, then a KPI event
+    svr.Post("/chat_events", [&](const httplib::Request& req, httplib::Response& res) {
+        handle_stream(req, res, StreamFormat::EventStream);
+    });
+
+    // Async jobs: submit now, collect later
+    svr.Post("/jobs", [&](const httplib::Request& req, httplib::Response& res) {
+        ChatRequest chat;
+        if (!ParseChatRequest(req, res, chat)) return;
+
+        std::optional<RequestKey> cache_key;
+        if (UseResponseCache(response_cache.get(), chat.body, chat.params)) {
+            cache_key = make_request_key(manager.model_type(), chat.sys_prompt, chat.user_prompt, chat.params);
+        }
+        const auto id = jobs.submit(std::move(chat.sys_prompt), std::move(chat.user_prompt),
+                                    std::move(chat.params), cache_key);
+        if (!id) {
+            RejectBusy(res, queue.retry_after_seconds());
+            return;
+        }
+        res.status = 202;
+        res.set_header("Location", "/jobs/" + *id);
+        res.set_content(json({{"id", *id}, {"status", "queued"}}).dump(), "application/json");
+    });
+
+    // ?wait_ms=N long-polls for completion; ?stream=1 streams output as it is produced
+    svr.Get(R"(/jobs/([A-Za-z0-9_]+))", [&](const httplib::Request& req, httplib::Response& res) {
+        const std::string id = req.matches[1];
+
+        if (req.get_param_value("stream") == "1") {
+            if (!jobs.wait(id, 0, std::chrono::milliseconds(0))) {
+                res.status = 404;
+                res.set_content("Error: unknown or expired job", "text/plain");
+                return;
+            }
+            res.set_chunked_content_provider(
+                "text/plain",
+                [&jobs, id](size_t /*offset*/, httplib::DataSink& sink) {
+                    size_t sent = 0;
+                    for (;;) {
+                        const auto job = jobs.wait(id, sent, std::chrono::seconds(1));
+                        if (!job) return false; // expired while streaming
+                        if (!job->output.empty()) {
+                            if (!sink.is_writable() || !sink.write(job->output.data(), job->output.size())) {
+                                return false;
+                            }
+                            sent = job->output_size;
+                        }
+                        if (job->finished()) {
+                            sink.done_with_trailer(GenerationMetadata(job->result));
+                            return true;
+                        }
+                    }
+                });
+            return;
+        }
+
+        std::chrono::milliseconds wait{0};
+        if (req.has_param("wait_ms")) {
+            try {
+                wait = std::min(c_job_max_wait,
+                                std::chrono::milliseconds(std::stol(req.get_param_value("wait_ms"))));
+            } catch (const std::exception&) {
+                res.status = 400;
+                res.set_content("Error: wait_ms must be an integer", "text/plain");
+                return;
+            }
+        }
+        const auto job = jobs.wait_finished(id, wait);
+        if (!job) {
+            res.status = 404;
+            res.set_content("Error: unknown or expired job", "text/plain");
+            return;
+        }
+        res.set_content(JobJson(*job).dump(-1, ' ', false, json::error_handler_t::replace),
+                        "application/json");
+    });
+
+    svr.Delete(R"(/jobs/([A-Za-z0-9_]+))", [&](const httplib::Request& req, httplib::Response& res) {
+        const std::string id = req.matches[1];
+        if (!jobs.cancel(id)) {
+            res.status = 404;
+            res.set_content("Error: unknown or expired job", "text/plain");
+            return;
+        }
+        res.status = 202;
+        res.set_content(json({{"id", id}, {"status", "cancelling"}}).dump(), "application/json");
+    });
+
+    // Many prompts in one request; results stream back as they finish
+    svr.Post("/chat_batch", [&](const httplib::Request& req, httplib::Response& res) {
+        json body;
+        if (!ParseRequestBody(req, res, body)) return;
+
+        // Either a bare array of items or {"items": [...], "max_concurrency": N}
+        const json* items = &body;
+        size_t limit = batch_concurrency;
+        if (body.is_object()) {
+            const auto it = body.find("items");
+            items = it != body.end() ? &*it : nullptr;
+            const auto max = body.find("max_concurrency");
+            if (max != body.end()) {
+                if (!max->is_number_integer() || max->get<long long>() <= 0) {
+                    res.status = 400;
+                    res.set_content("Error: max_concurrency must be a positive integer", "text/plain");
+                    return;
+                }
+                limit = std::min(limit, max->get<size_t>());
+            }
+        }
+        if (!items || !items->is_array() || items->empty()) {
+            res.status = 400;
+            res.set_content("Error: items must be a non-empty array", "text/plain");
+            return;
+        }
+
+        auto batch = std::make_shared<std::vector<BatchItem>>(items->size());
+        for (size_t i = 0; i < items->size(); ++i) {
+            const json& item = (*items)[i];
+            BatchItem& parsed = (*batch)[i];
+            std::string error;
+            if (!ParseBatchItem(item, parsed, error)) {
+                res.status = 400;
+                res.set_content("Error: items[" + std::to_string(i) + "]: " + error, "text/plain");
+                return;
+            }
+            parsed.index = i;
+            if (UseResponseCache(response_cache.get(), item, parsed.params)) {
+                parsed.cache_key = make_request_key(manager.model_type(), parsed.sys_prompt,
+                                                    parsed.user_prompt, parsed.params);
+            }
+        }
+
+        // Refuse up front when the queue is already full; once accepted, a
+        // batch waits for room instead of failing item by item. The slot
+        // admitted here is the one its first item runs in.
+        auto admitted = queue.try_admit();
+        if (!admitted) {
+            RejectBusy(res, queue.retry_after_seconds());
+            return;
+        }
+        auto slot = std::make_shared<InferenceQueue::Slot>(std::move(*admitted));
+
+        // NDJSON lines, or one msgpack/CBOR map per item for a binary Accept
+        const auto binary = binary_format_from_accept(req.get_header_value("Accept"));
+        res.set_chunked_content_provider(
+            binary ? content_type(*binary) : "application/x-ndjson",
+            [&queue, cache = response_cache.get(), batch, limit, binary, slot]
+            (size_t /*offset*/, httplib::DataSink& sink) {
+                BatchRunner runner(queue, cache, limit);
+                runner.adopt(std::move(*slot));
+                size_t started = 0;
+                for (size_t written = 0; written < batch->size();) {
+                    while (started < batch->size() && runner.try_start((*batch)[started])) {
+                        ++started;
+                    }
+                    const auto outcome = runner.next(c_batch_poll_interval);
+                    if (!outcome) continue;
+
+                    std::string line;
+                    if (binary) {
+                        append_binary(line, BatchOutcomeJson(*outcome), *binary);
+                    } else {
+                        line = BatchOutcomeJson(*outcome).dump(-1, ' ', false, json::error_handler_t::replace) + "\n";
+                    }
+                    if (!sink.is_writable() || !sink.write(line.data(), line.size())) {
+                        return false; // client gone; the runner aborts the rest
+                    }
+                    ++written;
+                }
+                sink.done();
+                return true;
+            });
     });
 
-    std::cout << "Server running at http://0.0.0.0:8080\n";
+    // Event loop front end: the same /hi, /chat and /chat_stream, but a
+    // request never holds a thread while it waits. Jobs are submitted to
+    // the queue and answered from their completion hooks.
+    if (event_loop_port > 0) {
+#ifdef CHATAPP_WITH_EPOLL
+        event_server = std::make_unique<EventLoopServer>(
+            event_loop_config, [&](const std::shared_ptr<EventLoopServer::Exchange>& accepted) {
+            // In flight until the handler and every job holding `exchange` are done
+            const uint64_t request_id = Tracer::instance().next_request_id();
+            const TraceScope trace(request_id);
+            accepted->add_header("X-Request-Id", RequestIdHeader(request_id));
+            const auto scope = std::make_shared<RequestScope>(metrics, accepted->request().path, request_id);
+            const std::shared_ptr<EventLoopServer::Exchange> exchange(
+                accepted.get(), [accepted, scope](EventLoopServer::Exchange*) {
+                    scope->set_status(accepted->status());
+                });
+            const httplib::Request& req = exchange->request();
+            const auto request_start = std::chrono::steady_clock::now();
+            httplib::Response res;
+
+            const bool stream = req.path == "/chat_stream";
+            if (req.method == "GET" && req.path == "/hi") {
+                res.set_content("Hello from Chat server!", "text/plain");
+                exchange->respond(res);
+                return;
+            }
+            if (req.method != "POST" || (req.path != "/chat" && !stream)) {
+                res.status = 404;
+                res.set_content("Error: not found", "text/plain");
+                exchange->respond(res);
+                return;
+            }
+
+            ChatRequest chat;
+            if (!ParseChatRequest(req, res, chat)) {
+                exchange->respond(res);
+                return;
+            }
+            std::vector<std::string> extract_keys;
+            std::string extract_error;
+            if (stream && !ParseExtractKeys(chat.body, StreamFormat::PlainText, extract_keys, extract_error)) {
+                res.status = 400;
+                res.set_content("Error: " + extract_error, "text/plain");
+                exchange->respond(res);
+                return;
+            }
+
+            const RequestKey request_key =
+                make_request_key(manager.model_type(), chat.sys_prompt, chat.user_prompt, chat.params);
+            const bool cacheable = UseResponseCache(response_cache.get(), chat.body, chat.params);
+            const auto encoder = stream ? MakeStreamEncoder(req, StreamFormat::PlainText, std::move(extract_keys),
+                                                            request_start)
+                                        : nullptr;
+            if (cacheable) {
+                if (auto hit = response_cache->lookup(request_key)) {
+                    if (!stream) {
+                        res.set_header("X-Cache", "hit");
+                        SetChatContent(req, res, hit->text(), hit->result(), request_start);
+                        exchange->respond(res);
+                        return;
+                    }
+                    std::string frame;
+                    hit->replay([&](const char* text, SentenceCode code) {
+                        encoder->encode_chunk(frame, text, std::strlen(text), code);
+                    });
+                    encoder->encode_finish(frame, hit->result());
+                    exchange->begin_stream(200, encoder->content_type(), {{"X-Cache", "hit"}});
+                    exchange->write(frame.data(), frame.size());
+                    exchange->finish(GenerationMetadata(hit->result()));
+                    return;
+                }
+            }
+
+            auto slot = queue.try_admit();
+            if (!slot) {
+                RejectBusy(res, queue.retry_after_seconds());
+                exchange->respond(res);
+                return;
+            }
+
+            // Touched only by the inference worker once the job is submitted
+            struct Generation {
+                std::atomic<bool> cancel{false};
+                std::string output;
+                ResponseCache::Recorder recorder;
+                FrameBuffer frame;
+                explicit Generation(const StreamFlushPolicy& policy) : frame(policy) {}
+            };
+            auto generation = std::make_shared<Generation>(flush_policy);
+            httplib::Headers headers;
+            if (cacheable) headers.emplace("X-Cache", "miss");
+
+            InferenceJob job;
+            job.sys_prompt = std::move(chat.sys_prompt);
+            job.user_prompt = std::move(chat.user_prompt);
+            job.params = std::move(chat.params);
+            job.cancel = &generation->cancel;
+            // The stream starts with the job, so one shed in the queue still
+            // gets its 503.
+            job.on_start = [exchange, generation, encoder, headers] {
+                if (exchange->closed()) {
+                    // Left while queued: skip the prefill
+                    generation->cancel.store(true, std::memory_order_relaxed);
+                    return;
+                }
+                if (encoder) exchange->begin_stream(200, encoder->content_type(), headers);
+            };
+            job.callback = [&, exchange, generation, encoder, cacheable](const char* text, SentenceCode code) {
+                if (exchange->closed()) {
+                    generation->cancel.store(true, std::memory_order_relaxed);
+                    return;
+                }
+                if (cacheable) generation->recorder.record(text);
+                if (!encoder) {
+                    generation->output += text;
+                    return;
+                }
+                FrameBuffer& frame = generation->frame;
+                encoder->encode_chunk(frame.data(), text, std::strlen(text), code);
+                if (!frame.due(code)) return;
+                exchange->write(frame.data().data(), frame.data().size());
+                frame.clear();
+                if (ring_config.overflow == RingOverflowPolicy::Cancel &&
+                    exchange->pending_bytes() > ring_config.capacity_bytes) {
+                    // Too far behind: drop this client like a disconnect
+                    metrics.stream_overflows.fetch_add(1, std::memory_order_relaxed);
+                    exchange->abort();
+                    generation->cancel.store(true, std::memory_order_relaxed);
+                }
+            };
+            job.on_complete = [&, exchange, generation, encoder, cacheable, request_key, headers, request_start]
+                              (const GenerationResult& result, std::exception_ptr error) {
+                if (!error && cacheable) {
+                    response_cache->insert(request_key, generation->recorder.finish(result));
+                }
+                if (exchange->closed()) {
+                    if (result.finish_reason == FinishReason::Aborted) {
+                        metrics.abandoned_generations.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    return;
+                }
+
+                std::string message;
+                if (error) {
+                    try {
+                        std::rethrow_exception(error);
+                    } catch (const std::bad_alloc&) {
+                        message = "Error: out of memory (bad_alloc) in manager.query";
+                    } catch (const std::exception& e) {
+                        message = std::string("Error in manager.query: ") + e.what();
+                    }
+                }
+                if (encoder) {
+                    FrameBuffer& frame = generation->frame;
+                    if (error) {
+                        encoder->encode_error(frame.data(), message);
+                    } else {
+                        encoder->encode_finish(frame.data(), result);
+                    }
+                    exchange->write(frame.data().data(), frame.data().size());
+                    exchange->finish(GenerationMetadata(result));
+                    return;
+                }
+
+                httplib::Response res;
+                if (error) {
+                    res.status = 500;
+                    res.set_content(message, "text/plain");
+                } else {
+                    res.headers = headers;
+                    SetChatContent(exchange->request(), res, generation->output, result, request_start);
+                }
+                exchange->respond(res);
+            };
+            auto pending = queue.submit(std::move(*slot), std::move(job));
+            std::lock_guard<std::mutex> lk(queued_exchanges_mu);
+            queued_exchanges.push_back({std::move(pending), exchange,
+                                        std::shared_ptr<std::atomic<bool>>(generation, &generation->cancel)});
+        });
+        event_server->set_tick(c_event_loop_tick, [&] {
+            const auto settled = [&](QueuedExchange& q) {
+                const auto exchange = q.exchange.lock();
+                if (!exchange) return true; // finished and answered
+                if (exchange->closed()) q.cancel->store(true, std::memory_order_relaxed);
+                if (!q.pending.poll()) return false;
+                if (q.pending.expired()) {
+                    httplib::Response res;
+                    RejectBusy(res, queue.retry_after_seconds());
+                    exchange->respond(res);
+                }
+                return true;
+            };
+            std::lock_guard<std::mutex> lk(queued_exchanges_mu);
+            queued_exchanges.erase(std::remove_if(queued_exchanges.begin(), queued_exchanges.end(), settled),
+                                   queued_exchanges.end());
+        });
+        try {
+            event_server->start(listen_host, event_loop_port);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+#else
+        std::cerr << c_option_event_port << " needs epoll; this build has no event loop front end\n";
+        return 1;
+#endif
+    }
+
+    // Without TCP_NODELAY a keep-alive response whose head and body are
+    // written separately stalls on the client's delayed ACK (~40 ms).
+    if (tcp_server) tcp_server->set_tcp_nodelay(true);
+    if (tcp_server && !tcp_server->bind_to_port(listen_host, listen_port)) {
+        std::cerr << "Cannot listen on " << listen_host << ":" << listen_port << "\n";
+        return 1;
+    }
+    if (unix_server && !BindUnixSocket(*unix_server, unix_socket_path, unix_socket_mode)) {
+        return 1;
+    }
+
+    if (tcp_server) {
+        std::cout << "Server running at http://" << listen_host << ":" << listen_port << "\n";
+    }
+    if (unix_server) {
+        std::cout << "Server running on UNIX socket " << unix_socket_path << "\n";
+    }
     std::cout << " - POST /chat        (receives JSON, returns plain text)\n";
     std::cout << " - POST /chat_stream (receives JSON, streams plain text)\n";
+    std::cout << " - POST /chat_events (receives JSON, streams Server-Sent Events)\n";
+    std::cout << " - POST /chat_batch  (receives a JSON array of requests, streams NDJSON results as they finish)\n";
+    std::cout << " - POST /jobs        (receives JSON, returns a job id at once)\n";
+    std::cout << " - GET  /jobs/{id}   (job status and output; ?wait_ms=N long-polls, ?stream=1 streams)\n";
+    std::cout << " - GET  /metrics     (Prometheus metrics)\n";
+    std::cout << " - GET  /debug/trace (recent request spans as Chrome trace JSON; ?clear=1 empties)\n";
+    if (event_server) {
+        std::cout << "Event loop front end at http://" << listen_host << ":" << event_loop_port
+                  << " (/hi, /chat, /chat_stream; " << event_loop_config.threads << " threads)\n";
+    }
 
-    svr.listen("0.0.0.0", 8080);
+    svr.listen_after_bind();
     return 0;
 }
@@ -0,0 +1,156 @@
+// ---------------------------------------------------------------------
+// Metrics.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "Metrics.hpp"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+    void AppendNumber(std::string& out, double value, const char* format = "%.17g") {
+        char number[32];
+        std::snprintf(number, sizeof(number), format, value);
+        out += number;
+    }
+
+    void AppendHeader(std::string& out, const char* name, const char* type, const char* help) {
+        out += "# HELP "; out += name; out += ' '; out += help; out += '\n';
+        out += "# TYPE "; out += name; out += ' '; out += type; out += '\n';
+    }
+} // namespace
+
+// ---------------------------------------------------------------------
+// Histogram Implementation
+// ---------------------------------------------------------------------
+Histogram::Histogram(const double* bounds, size_t count)
+    : m_bounds(bounds, bounds + count),
+      m_counts(std::make_unique<std::atomic<uint64_t>[]>(count + 1))
+{
+}
+
+void Histogram::observe(double value) {
+    // First bucket whose upper bound is >= value ("le" is inclusive)
+    const size_t bucket = static_cast<size_t>(
+        std::lower_bound(m_bounds.begin(), m_bounds.end(), value) - m_bounds.begin());
+    m_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    double sum = m_sum.load(std::memory_order_relaxed);
+    while (!m_sum.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)) {
+    }
+}
+
+void Histogram::render(std::string& out, const char* name, const char* help) const {
+    AppendHeader(out, name, "histogram", help);
+
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i <= m_bounds.size(); ++i) {
+        cumulative += m_counts[i].load(std::memory_order_relaxed);
+        out += name; out += "_bucket{le=\"";
+        if (i < m_bounds.size()) {
+            AppendNumber(out, m_bounds[i], "%g"); // bounds are short decimals; keep the labels readable
+        } else {
+            out += "+Inf";
+        }
+        out += "\"} ";
+        out += std::to_string(cumulative);
+        out += '\n';
+    }
+    out += name; out += "_sum ";
+    AppendNumber(out, m_sum.load(std::memory_order_relaxed));
+    out += '\n';
+    out += name; out += "_count ";
+    out += std::to_string(cumulative);
+    out += '\n';
+}
+
+// ---------------------------------------------------------------------
+// RequestCounters Implementation
+// ---------------------------------------------------------------------
+RequestCounters::RequestCounters()
+{
+    add_endpoint("other");
+}
+
+void RequestCounters::add_endpoint(std::string_view endpoint) {
+    for (const Endpoint& existing : m_endpoints) {
+        if (existing.name == endpoint) return;
+    }
+    m_endpoints.push_back({std::string(endpoint),
+                           std::make_unique<std::atomic<uint64_t>[]>(c_status_slots)});
+}
+
+void RequestCounters::record(std::string_view endpoint, int status) {
+    const Endpoint* target = &m_endpoints.front();
+    for (const Endpoint& candidate : m_endpoints) {
+        if (candidate.name == endpoint) {
+            target = &candidate;
+            break;
+        }
+    }
+    const size_t slot = status >= c_min_status && status <= c_max_status
+                            ? static_cast<size_t>(status - c_min_status)
+                            : c_status_slots - 1;
+    target->counts[slot].fetch_add(1, std::memory_order_relaxed);
+}
+
+void RequestCounters::render(std::string& out) const {
+    static const char* const c_name = "chatapp_http_requests_total";
+    AppendHeader(out, c_name, "counter", "HTTP responses by endpoint and status code.");
+    for (const Endpoint& endpoint : m_endpoints) {
+        for (size_t slot = 0; slot < c_status_slots; ++slot) {
+            const uint64_t count = endpoint.counts[slot].load(std::memory_order_relaxed);
+            if (count == 0) continue;
+            out += c_name; out += "{endpoint=\""; out += endpoint.name; out += "\",code=\"";
+            out += slot + 1 < c_status_slots ? std::to_string(c_min_status + static_cast<int>(slot))
+                                             : std::string("other");
+            out += "\"} ";
+            out += std::to_string(count);
+            out += '\n';
+        }
+    }
+}
+
+// ---------------------------------------------------------------------
+// ServerMetrics Implementation
+// ---------------------------------------------------------------------
+std::string ServerMetrics::render() const {
+    std::string out;
+    append_metric(out, "chatapp_abandoned_generations_total", "counter",
+                  "Generations aborted because the client disconnected.",
+                  static_cast<double>(abandoned_generations.load(std::memory_order_relaxed)));
+    append_metric(out, "chatapp_stream_overflows_total", "counter",
+                  "Streaming clients dropped for falling a full token buffer behind.",
+                  static_cast<double>(stream_overflows.load(std::memory_order_relaxed)));
+    append_metric(out, "chatapp_in_flight_requests", "gauge",
+                  "Requests received and not yet fully answered.",
+                  static_cast<double>(in_flight_requests.load(std::memory_order_relaxed)));
+    requests.render(out);
+
+    queue_wait_seconds.render(out, "chatapp_queue_wait_seconds",
+                              "Time from enqueue until a worker started the generation.");
+    ttft_seconds.render(out, "chatapp_time_to_first_token_seconds",
+                        "Time from enqueue until the first generated token, queue wait included.");
+    inter_token_seconds.render(out, "chatapp_inter_token_latency_seconds",
+                               "Time between consecutive tokens of a generation.");
+    prefill_tok_per_s.render(out, "chatapp_prefill_tokens_per_second",
+                             "Prompt processing rate per generation (prompt tokens estimated from bytes).");
+    decode_tok_per_s.render(out, "chatapp_decode_tokens_per_second",
+                            "Token generation rate per generation, after the first token.");
+    pool_wait_seconds.render(out, "chatapp_dialog_pool_wait_seconds",
+                             "Time waiting for a free pooled dialogue.");
+    dialog_lock_wait_seconds.render(out, "chatapp_dialog_lock_wait_seconds",
+                                    "Time waiting for a dialogue's lock in ChatManager.");
+    dialog_lock_hold_seconds.render(out, "chatapp_dialog_lock_hold_seconds",
+                                    "Time a dialogue's lock in ChatManager was held per query.");
+    return out;
+}
+
+void append_metric(std::string& out, const char* name, const char* type,
+                   const char* help, double value) {
+    AppendHeader(out, name, type, help);
+    out += name; out += ' ';
+    AppendNumber(out, value);
+    out += '\n';
+}
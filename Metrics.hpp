@@ -0,0 +1,110 @@
+// ---------------------------------------------------------------------
+// Metrics.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ---------------------------------------------------------------------
+// Histogram: fixed-bucket distribution, safe to update from any thread
+// ---------------------------------------------------------------------
+/// Buckets are fixed at construction, so observe() is a binary search of
+/// the upper bounds and two relaxed atomic updates: no lock and no
+/// allocation, cheap enough to call once per generated token.
+class Histogram {
+public:
+    /// `bounds` are the bucket upper bounds in ascending order; +Inf is implied.
+    Histogram(const double* bounds, size_t count);
+
+    template <size_t N>
+    explicit Histogram(const double (&bounds)[N]) : Histogram(bounds, N) {}
+
+    void observe(double value);
+
+    /// Append HELP/TYPE and the cumulative _bucket, _sum and _count samples.
+    void render(std::string& out, const char* name, const char* help) const;
+
+private:
+    std::vector<double> m_bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_counts; ///< Per bucket (not cumulative), +Inf last
+    std::atomic<double> m_sum{0.0};
+};
+
+// ---------------------------------------------------------------------
+// RequestCounters: HTTP responses by endpoint and status code
+// ---------------------------------------------------------------------
+/// Endpoints are registered before serving; afterwards the table is
+/// read-only and record() only increments an atomic. Requests for an
+/// unregistered endpoint are counted under "other".
+class RequestCounters {
+public:
+    RequestCounters();
+
+    /// Register `endpoint` (e.g. "/chat"). Not thread-safe; call before serving.
+    void add_endpoint(std::string_view endpoint);
+
+    void record(std::string_view endpoint, int status);
+
+    void render(std::string& out) const;
+
+private:
+    static constexpr int c_min_status = 100;
+    static constexpr int c_max_status = 599;
+    static constexpr size_t c_status_slots = c_max_status - c_min_status + 2; ///< Last slot: out of range
+
+    struct Endpoint {
+        std::string name;
+        std::unique_ptr<std::atomic<uint64_t>[]> counts; ///< Indexed by status - c_min_status
+    };
+
+    std::vector<Endpoint> m_endpoints; ///< [0] is "other"
+};
+
+// ---------------------------------------------------------------------
+// ServerMetrics: process-wide counters exported on GET /metrics
+// ---------------------------------------------------------------------
+class ServerMetrics {
+public:
+    /// Streaming generations aborted because the client disconnected.
+    std::atomic<uint64_t> abandoned_generations{0};
+
+    /// Streaming clients dropped for falling a full token buffer behind.
+    std::atomic<uint64_t> stream_overflows{0};
+
+    /// Requests received and not yet fully answered, on all front ends.
+    std::atomic<int64_t> in_flight_requests{0};
+
+    RequestCounters requests;
+
+    Histogram queue_wait_seconds{c_latency_buckets};   ///< Enqueued until a worker picks the job up
+    Histogram ttft_seconds{c_latency_buckets};         ///< Enqueued until the first token
+    Histogram inter_token_seconds{c_token_buckets};    ///< Between consecutive tokens of one generation
+    Histogram prefill_tok_per_s{c_rate_buckets};       ///< Per generation
+    Histogram decode_tok_per_s{c_rate_buckets};        ///< Per generation, after the first token
+    Histogram pool_wait_seconds{c_latency_buckets};    ///< Waiting for a free pooled dialogue
+    Histogram dialog_lock_wait_seconds{c_latency_buckets};
+    Histogram dialog_lock_hold_seconds{c_latency_buckets};
+
+    /// Prometheus text exposition format.
+    std::string render() const;
+
+private:
+    static constexpr double c_latency_buckets[] = {
+        0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60};
+    static constexpr double c_token_buckets[] = {
+        0.001, 0.002, 0.005, 0.01, 0.02, 0.035, 0.05, 0.075, 0.1, 0.15, 0.25, 0.5, 1};
+    static constexpr double c_rate_buckets[] = {
+        1, 2, 5, 10, 15, 20, 30, 50, 75, 100, 200, 500, 1000, 5000};
+};
+
+/// Append one sample with its HELP/TYPE header in exposition format.
+void append_metric(std::string& out, const char* name, const char* type,
+                   const char* help, double value);
@@ -0,0 +1,86 @@
+// ---------------------------------------------------------------------
+// PrefixCache.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "PrefixCache.hpp"
+#include "Hash.hpp"
+
+// ---------------------------------------------------------------------
+// PrefixCache Implementation
+// ---------------------------------------------------------------------
+PrefixCache::PrefixCache(size_t budget_bytes)
+    : m_budget_bytes(budget_bytes)
+{
+}
+
+uint64_t PrefixCache::make_key(llm::prompt::ModelType model, std::string_view tagged_prefix) {
+    const char tag = static_cast<char>(model);
+    return fnv1a64(tagged_prefix, fnv1a64(std::string_view(&tag, 1)));
+}
+
+std::shared_ptr<const DialogState> PrefixCache::lookup(llm::prompt::ModelType model,
+                                                       std::string_view tagged_prefix)
+{
+    const uint64_t key = make_key(model, tagged_prefix);
+
+    std::lock_guard<std::mutex> lk(m_mu);
+    auto it = m_index.find(key);
+    if (it == m_index.end() ||
+        it->second->model != model || it->second->prefix != tagged_prefix)
+    {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    return it->second->state;
+}
+
+void PrefixCache::insert(llm::prompt::ModelType model,
+                         std::string_view tagged_prefix,
+                         std::shared_ptr<const DialogState> state)
+{
+    if (!state || state->size_bytes() > m_budget_bytes) {
+        return;
+    }
+    const uint64_t key = make_key(model, tagged_prefix);
+
+    // Evicted snapshots are released outside the lock (Genie removes files).
+    LruList evicted;
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        auto it = m_index.find(key);
+        if (it != m_index.end()) {
+            m_bytes -= it->second->state->size_bytes();
+            evicted.splice(evicted.end(), m_lru, it->second);
+            m_index.erase(it);
+        }
+
+        m_bytes += state->size_bytes();
+        m_lru.push_front(Entry{key, model, std::string(tagged_prefix), std::move(state)});
+        m_index[key] = m_lru.begin();
+
+        while (m_bytes > m_budget_bytes) {
+            auto last = std::prev(m_lru.end());
+            m_bytes -= last->state->size_bytes();
+            m_index.erase(last->key);
+            evicted.splice(evicted.end(), m_lru, last);
+            m_evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+PrefixCache::Stats PrefixCache::stats() const {
+    Stats s;
+    s.hits = m_hits.load(std::memory_order_relaxed);
+    s.misses = m_misses.load(std::memory_order_relaxed);
+    s.evictions = m_evictions.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lk(m_mu);
+    s.entries = m_lru.size();
+    s.bytes = m_bytes;
+    return s;
+}
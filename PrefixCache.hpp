@@ -0,0 +1,69 @@
+// ---------------------------------------------------------------------
+// PrefixCache.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "InferenceBackend.hpp"
+#include "PromptHandler.hpp"
+
+// ---------------------------------------------------------------------
+// PrefixCache: dialog snapshots taken right after the system prompt
+// ---------------------------------------------------------------------
+/// Keyed by a hash of the model type plus the tagged system prompt. A hit
+/// lets a request restore the snapshot and prefill only its user turn.
+/// Entries are evicted least-recently-used once the summed snapshot size
+/// exceeds the budget. Thread-safe.
+class PrefixCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+    };
+
+    explicit PrefixCache(size_t budget_bytes);
+
+    std::shared_ptr<const DialogState> lookup(llm::prompt::ModelType model,
+                                              std::string_view tagged_prefix);
+
+    void insert(llm::prompt::ModelType model,
+                std::string_view tagged_prefix,
+                std::shared_ptr<const DialogState> state);
+
+    Stats stats() const;
+
+private:
+    struct Entry {
+        uint64_t key;
+        llm::prompt::ModelType model;
+        std::string prefix; ///< Guards against hash collisions
+        std::shared_ptr<const DialogState> state;
+    };
+    using LruList = std::list<Entry>;
+
+    static uint64_t make_key(llm::prompt::ModelType model, std::string_view tagged_prefix);
+
+    const size_t m_budget_bytes;
+
+    mutable std::mutex m_mu;
+    LruList m_lru; ///< Front = most recently used
+    std::unordered_map<uint64_t, LruList::iterator> m_index;
+    size_t m_bytes = 0;
+
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+    std::atomic<uint64_t> m_evictions{0};
+};
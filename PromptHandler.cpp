@@ -143,4 +143,36 @@ std::string PromptUtils::get_subseq_prompt_with_tag(
     return t.end_assistant + t.begin_user + user_prompt + t.end_user + t.begin_assistant;
 }
 
+/**
+ * @brief Generate the system-prompt prefix of the initial prompt.
+ *
+ * get_system_prefix_with_tag(s) + get_user_suffix_with_tag(u) is identical
+ * to get_prompt_with_tag(s, u). The prefix depends only on the system
+ * prompt, so its processed state can be cached and shared across requests.
+ *
+ * @param system_prompt Instructions for the system role.
+ * @return A formatted string containing the start and system sections.
+ */
+std::string PromptUtils::get_system_prefix_with_tag(
+    const std::string& system_prompt
+) {
+    auto t = getTemplates(m_model);
+
+    return t.begin_prompt + t.begin_system + system_prompt;
+}
+
+/**
+ * @brief Generate the user part of the initial prompt.
+ *
+ * @param user_prompt The first user message.
+ * @return A formatted string containing user + assistant sections.
+ */
+std::string PromptUtils::get_user_suffix_with_tag(
+    const std::string& user_prompt
+) {
+    auto t = getTemplates(m_model);
+
+    return t.begin_user + user_prompt + t.end_user + t.begin_assistant;
+}
+
 } // namespace llm::prompt
@@ -47,6 +47,19 @@ class PromptUtils
     std::string get_subseq_prompt_with_tag(
         const std::string& user_prompt
     );
+
+    /// Generate the system part of the initial prompt (cacheable prefix).
+    std::string get_system_prefix_with_tag(
+        const std::string& system_prompt
+    );
+
+    /// Generate the user part of the initial prompt, following the prefix.
+    std::string get_user_suffix_with_tag(
+        const std::string& user_prompt
+    );
+
+    /// Model these utilities format for.
+    ModelType model() const { return m_model; }
 };
 
 } // namespace llm::prompt
@@ -0,0 +1,47 @@
+// ---------------------------------------------------------------------
+// RequestKey.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "RequestKey.hpp"
+#include "Hash.hpp"
+
+namespace {
+    constexpr uint64_t c_second_seed = 0x9e3779b97f4a7c15ull;
+
+    template <typename T>
+    void append_value(std::string& out, const T& value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void append_string(std::string& out, std::string_view s) {
+        append_value(out, s.size()); // length prefix keeps fields unambiguous
+        out.append(s);
+    }
+} // namespace
+
+RequestKey make_request_key(llm::prompt::ModelType model,
+                            const std::string& sys_prompt,
+                            const std::string& user_prompt,
+                            const GenerationParams& params)
+{
+    llm::prompt::PromptUtils prompt_utils(model);
+    auto material = std::make_shared<std::string>();
+    std::string& m = *material;
+    append_value(m, model);
+    append_string(m, prompt_utils.get_prompt_with_tag(sys_prompt, user_prompt));
+
+    append_value(m, params.max_new_tokens);
+    append_value(m, params.temperature.value_or(-1.0f));
+    append_value(m, params.top_p.value_or(-1.0f));
+    append_value(m, params.stop.size());
+    for (const auto& stop : params.stop) {
+        append_string(m, stop);
+    }
+    append_value(m, params.stop_at_json_end);
+
+    const uint64_t h1 = fnv1a64(m);
+    const uint64_t h2 = fnv1a64(m, c_fnv1a_offset ^ c_second_seed);
+    return RequestKey{h1, h2, std::move(material)};
+}
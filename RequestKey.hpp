@@ -0,0 +1,46 @@
+// ---------------------------------------------------------------------
+// RequestKey.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "InferenceBackend.hpp"
+#include "PromptHandler.hpp"
+
+// ---------------------------------------------------------------------
+// RequestKey: 128-bit fingerprint of a generation request
+// ---------------------------------------------------------------------
+/// Two differently seeded FNV-1a hashes over the model, the tagged
+/// prompt and every GenerationParams field. The hashes pick the bucket;
+/// the serialized fields themselves are kept so that caches can tell a
+/// collision from a repeat before handing one client's output to another.
+/// Two requests with the same material produce the same output under
+/// greedy decoding.
+struct RequestKey {
+    uint64_t h1 = 0;
+    uint64_t h2 = 0;
+    std::shared_ptr<const std::string> material; ///< Canonical bytes that were hashed
+
+    /// Fingerprint equality, for hash map lookups.
+    bool operator==(const RequestKey& o) const { return h1 == o.h1 && h2 == o.h2; }
+
+    /// Same request, not merely the same fingerprint.
+    bool same_request(const RequestKey& o) const {
+        return *this == o && material && o.material && *material == *o.material;
+    }
+};
+
+struct RequestKeyHash {
+    size_t operator()(const RequestKey& k) const { return static_cast<size_t>(k.h1 ^ (k.h2 << 1)); }
+};
+
+RequestKey make_request_key(llm::prompt::ModelType model,
+                            const std::string& sys_prompt,
+                            const std::string& user_prompt,
+                            const GenerationParams& params);
@@ -0,0 +1,123 @@
+// ---------------------------------------------------------------------
+// ResponseCache.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "ResponseCache.hpp"
+#include <cstring>
+
+namespace {
+    constexpr size_t c_entry_overhead = 128; ///< Node, index and control block, roughly
+} // namespace
+
+// ---------------------------------------------------------------------
+// ResponseCache::Entry / Recorder
+// ---------------------------------------------------------------------
+void ResponseCache::Entry::replay(const ChatManager::ResponseCallback& callback) const {
+    std::string chunk;
+    uint32_t begin = 0;
+    for (size_t i = 0; i < m_chunk_ends.size(); ++i) {
+        chunk.assign(m_text, begin, m_chunk_ends[i] - begin);
+        callback(chunk.c_str(), i == 0 ? SentenceCode::Begin : SentenceCode::Continue);
+        begin = m_chunk_ends[i];
+    }
+    callback("", SentenceCode::End);
+}
+
+size_t ResponseCache::Entry::size_bytes() const {
+    return c_entry_overhead + m_text.size() + m_chunk_ends.size() * sizeof(uint32_t);
+}
+
+void ResponseCache::Recorder::record(const char* text) {
+    const size_t n = std::strlen(text);
+    if (n == 0) return;
+    m_entry->m_text.append(text, n);
+    m_entry->m_chunk_ends.push_back(static_cast<uint32_t>(m_entry->m_text.size()));
+}
+
+std::shared_ptr<const ResponseCache::Entry>
+ResponseCache::Recorder::finish(const GenerationResult& result) {
+    m_entry->m_result = result;
+    // A hit runs neither phase; only the prompt size still describes it.
+    m_entry->m_result.prefill_us = 0;
+    m_entry->m_result.decode_us = 0;
+    m_entry->m_result.prefilled_bytes = 0;
+    return std::move(m_entry);
+}
+
+// ---------------------------------------------------------------------
+// ResponseCache Implementation
+// ---------------------------------------------------------------------
+ResponseCache::ResponseCache(size_t budget_bytes, std::chrono::seconds ttl)
+    : m_budget_bytes(budget_bytes), m_ttl(ttl)
+{
+}
+
+bool ResponseCache::is_cacheable(const GenerationParams& params, bool explicitly_cacheable) {
+    return explicitly_cacheable ||
+           (params.temperature.has_value() && *params.temperature == 0.0f);
+}
+
+std::shared_ptr<const ResponseCache::Entry> ResponseCache::lookup(const Key& key) {
+    std::lock_guard<std::mutex> lk(m_mu);
+    auto it = m_index.find(key);
+    if (it == m_index.end() || !it->second->key.same_request(key)) {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    if (std::chrono::steady_clock::now() >= it->second->expires) {
+        erase_locked(it->second);
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    return it->second->entry;
+}
+
+void ResponseCache::insert(const Key& key, std::shared_ptr<const Entry> entry) {
+    if (!entry || entry->result().finish_reason == FinishReason::Aborted ||
+        slot_bytes(key, *entry) > m_budget_bytes)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lk(m_mu);
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+        erase_locked(it->second);
+    }
+
+    m_bytes += slot_bytes(key, *entry);
+    m_lru.push_front(Slot{key, std::chrono::steady_clock::now() + m_ttl, std::move(entry)});
+    m_index[key] = m_lru.begin();
+
+    while (m_bytes > m_budget_bytes) {
+        erase_locked(std::prev(m_lru.end()));
+        m_evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+size_t ResponseCache::slot_bytes(const Key& key, const Entry& entry) {
+    return entry.size_bytes() + (key.material ? key.material->size() : 0);
+}
+
+void ResponseCache::erase_locked(LruList::iterator it) {
+    m_bytes -= slot_bytes(it->key, *it->entry);
+    m_index.erase(it->key);
+    m_lru.erase(it);
+}
+
+ResponseCache::Stats ResponseCache::stats() const {
+    Stats s;
+    s.hits = m_hits.load(std::memory_order_relaxed);
+    s.misses = m_misses.load(std::memory_order_relaxed);
+    s.evictions = m_evictions.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lk(m_mu);
+    s.entries = m_lru.size();
+    s.bytes = m_bytes;
+    return s;
+}
@@ -0,0 +1,102 @@
+// ---------------------------------------------------------------------
+// ResponseCache.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ChatManager.hpp"
+#include "RequestKey.hpp"
+
+// ---------------------------------------------------------------------
+// ResponseCache: exact-match cache of finished generations
+// ---------------------------------------------------------------------
+/// Only deterministic (temperature 0) or explicitly cacheable requests
+/// are cached. Entries keep the original token chunking so a hit can be
+/// replayed through the same streaming path as a live generation. LRU
+/// bounded by bytes, with a per-entry TTL. Thread-safe.
+class ResponseCache {
+public:
+    using Key = RequestKey;
+
+    /// Immutable cached response.
+    class Entry {
+    public:
+        /// Feed the cached chunks to `callback` exactly as ChatManager did.
+        void replay(const ChatManager::ResponseCallback& callback) const;
+
+        const std::string& text() const { return m_text; }
+        const GenerationResult& result() const { return m_result; }
+        size_t size_bytes() const;
+
+    private:
+        friend class ResponseCache;
+        std::string m_text;
+        std::vector<uint32_t> m_chunk_ends; ///< End offset of each chunk in m_text
+        GenerationResult m_result;
+    };
+
+    /// Collects the chunks of a live generation for insertion.
+    class Recorder {
+    public:
+        void record(const char* text);
+        std::shared_ptr<const Entry> finish(const GenerationResult& result);
+
+    private:
+        std::shared_ptr<Entry> m_entry = std::make_shared<Entry>();
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+    };
+
+    ResponseCache(size_t budget_bytes, std::chrono::seconds ttl);
+
+    /// Whether a request may be served from / stored in the cache.
+    static bool is_cacheable(const GenerationParams& params, bool explicitly_cacheable);
+
+    std::shared_ptr<const Entry> lookup(const Key& key);
+
+    /// Stores completed generations only (not aborted ones).
+    void insert(const Key& key, std::shared_ptr<const Entry> entry);
+
+    Stats stats() const;
+
+private:
+    struct Slot {
+        Key key;   ///< Material guards against fingerprint collisions
+        std::chrono::steady_clock::time_point expires;
+        std::shared_ptr<const Entry> entry;
+    };
+    using LruList = std::list<Slot>;
+
+    /// Budgeted size of a slot: the entry plus its key material.
+    static size_t slot_bytes(const Key& key, const Entry& entry);
+    void erase_locked(LruList::iterator it);
+
+    const size_t m_budget_bytes;
+    const std::chrono::seconds m_ttl;
+
+    mutable std::mutex m_mu;
+    LruList m_lru; ///< Front = most recently used
+    std::unordered_map<Key, LruList::iterator, RequestKeyHash> m_index;
+    size_t m_bytes = 0;
+
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+    std::atomic<uint64_t> m_evictions{0};
+};
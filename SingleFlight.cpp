@@ -0,0 +1,156 @@
+// ---------------------------------------------------------------------
+// SingleFlight.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "SingleFlight.hpp"
+#include <cstring>
+
+// ---------------------------------------------------------------------
+// SharedGeneration Implementation
+// ---------------------------------------------------------------------
+void SharedGeneration::publish(const char* text) {
+    const size_t n = std::strlen(text);
+    if (n == 0) return;
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        m_text.append(text, n);
+        m_chunk_ends.push_back(m_text.size());
+    }
+    m_cv.notify_all();
+}
+
+void SharedGeneration::finish(const GenerationResult& result) {
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        m_result = result;
+        m_done = true;
+    }
+    m_cv.notify_all();
+}
+
+void SharedGeneration::fail(std::exception_ptr error) {
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        m_error = std::move(error);
+        m_done = true;
+    }
+    m_cv.notify_all();
+}
+
+GenerationResult SharedGeneration::follow(const ChatManager::ResponseCallback& callback,
+                                          const std::atomic<bool>& gone)
+{
+    std::string chunk;
+    size_t next = 0;
+
+    std::unique_lock<std::mutex> lk(m_mu);
+    for (;;) {
+        // Catch up on everything published so far, delivering outside the
+        // lock so a slow client never stalls the leader.
+        while (next < m_chunk_ends.size()) {
+            const size_t begin = next ? m_chunk_ends[next - 1] : 0;
+            chunk.assign(m_text, begin, m_chunk_ends[next] - begin);
+            const SentenceCode code = next == 0 ? SentenceCode::Begin : SentenceCode::Continue;
+            ++next;
+
+            lk.unlock();
+            callback(chunk.c_str(), code);
+            if (gone.load(std::memory_order_relaxed)) {
+                GenerationResult abandoned;
+                abandoned.generated_tokens = next;
+                abandoned.finish_reason = FinishReason::Aborted;
+                return abandoned;
+            }
+            lk.lock();
+        }
+        if (m_done) break;
+        m_cv.wait(lk);
+    }
+
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+    const GenerationResult result = m_result;
+    lk.unlock();
+    callback("", result.finish_reason == FinishReason::Aborted ? SentenceCode::Abort
+                                                               : SentenceCode::End);
+    return result;
+}
+
+GenerationResult SharedGeneration::wait(std::string& output) {
+    std::unique_lock<std::mutex> lk(m_mu);
+    m_cv.wait(lk, [this] { return m_done; });
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+    output = m_text;
+    return m_result;
+}
+
+void SharedGeneration::detach() {
+    if (m_attached.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_cancel.store(true, std::memory_order_relaxed);
+    }
+}
+
+// ---------------------------------------------------------------------
+// SingleFlight Implementation
+// ---------------------------------------------------------------------
+SingleFlight::Ticket SingleFlight::join(const RequestKey& key) {
+    std::lock_guard<std::mutex> lk(m_mu);
+    auto it = m_inflight.find(key);
+    if (it != m_inflight.end() && !it->second.key.same_request(key)) {
+        // Fingerprint collision with a different prompt: run on our own,
+        // without registering, rather than share its output.
+        return Ticket{std::make_shared<SharedGeneration>(), true};
+    }
+    if (it == m_inflight.end()) {
+        it = m_inflight.emplace(key, Flight{key, nullptr}).first;
+    }
+    auto& slot = it->second.generation;
+
+    // A generation whose clients have all left is already aborting;
+    // start a fresh one rather than inherit a truncated reply. Attach
+    // only while someone else still is, so we cannot revive it.
+    uint32_t attached = slot ? slot->m_attached.load(std::memory_order_relaxed) : 0;
+    while (attached != 0 &&
+           !slot->m_attached.compare_exchange_weak(attached, attached + 1,
+                                                   std::memory_order_acq_rel)) {
+    }
+    if (attached != 0) {
+        slot->m_followers.fetch_add(1, std::memory_order_relaxed);
+        m_coalesced.fetch_add(1, std::memory_order_relaxed);
+        return Ticket{slot, false};
+    }
+
+    slot = std::make_shared<SharedGeneration>();
+    return Ticket{slot, true};
+}
+
+void SingleFlight::complete(const RequestKey& key,
+                            const std::shared_ptr<SharedGeneration>& generation,
+                            const GenerationResult& result)
+{
+    forget(key, generation);
+    generation->finish(result);
+}
+
+void SingleFlight::complete(const RequestKey& key,
+                            const std::shared_ptr<SharedGeneration>& generation,
+                            std::exception_ptr error)
+{
+    forget(key, generation);
+    generation->fail(std::move(error));
+}
+
+void SingleFlight::forget(const RequestKey& key,
+                          const std::shared_ptr<SharedGeneration>& generation)
+{
+    std::lock_guard<std::mutex> lk(m_mu);
+    auto it = m_inflight.find(key);
+    if (it != m_inflight.end() && it->second.generation == generation) {
+        m_inflight.erase(it);
+    }
+}
@@ -0,0 +1,107 @@
+// ---------------------------------------------------------------------
+// SingleFlight.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ChatManager.hpp"
+#include "RequestKey.hpp"
+
+// ---------------------------------------------------------------------
+// SharedGeneration: one running generation and everyone waiting on it
+// ---------------------------------------------------------------------
+/// The leader runs the query and publishes each chunk; followers replay
+/// what has been produced so far and then block for the rest. The
+/// generation is cancelled once every attached client has detached.
+class SharedGeneration {
+public:
+    /// Leader: record a chunk and wake followers.
+    void publish(const char* text);
+
+    /// Leader: mark the generation finished (or failed) and wake followers.
+    void finish(const GenerationResult& result);
+    void fail(std::exception_ptr error);
+
+    /// Follower: deliver every chunk, past and future, to `callback`
+    /// (Begin/Continue, then "" with End or Abort), stopping early once
+    /// `gone` is set; the caller still has to detach(). Rethrows the
+    /// leader's error.
+    GenerationResult follow(const ChatManager::ResponseCallback& callback,
+                            const std::atomic<bool>& gone);
+
+    /// Follower: wait for the whole output.
+    GenerationResult wait(std::string& output);
+
+    /// A client stopped listening. Once none are left the leader's query
+    /// sees cancel() set and aborts.
+    void detach();
+
+    /// Pass as the cancel flag of the leader's query.
+    const std::atomic<bool>* cancel() const { return &m_cancel; }
+
+    size_t followers() const { return m_followers.load(std::memory_order_relaxed); }
+
+private:
+    friend class SingleFlight;
+
+    mutable std::mutex m_mu;
+    std::condition_variable m_cv;
+    std::string m_text;
+    std::vector<size_t> m_chunk_ends;  ///< End offset of each published chunk
+    bool m_done = false;
+    GenerationResult m_result;
+    std::exception_ptr m_error;
+
+    std::atomic<uint32_t> m_attached{1}; ///< Leader counts as attached
+    std::atomic<uint64_t> m_followers{0};
+    std::atomic<bool> m_cancel{false};
+};
+
+// ---------------------------------------------------------------------
+// SingleFlight: coalesces identical in-flight requests
+// ---------------------------------------------------------------------
+/// Requests with the same RequestKey (tagged prompt and sampling params)
+/// that arrive while a generation is running attach to it instead of
+/// queueing a second copy. Thread-safe.
+class SingleFlight {
+public:
+    struct Ticket {
+        std::shared_ptr<SharedGeneration> generation;
+        bool leader = false; ///< Caller must run the query and complete() it
+    };
+
+    /// Attach to the running generation for `key`, or start a new one.
+    Ticket join(const RequestKey& key);
+
+    /// Leader: stop accepting followers for `key`, then finish or fail the generation.
+    void complete(const RequestKey& key, const std::shared_ptr<SharedGeneration>& generation,
+                  const GenerationResult& result);
+    void complete(const RequestKey& key, const std::shared_ptr<SharedGeneration>& generation,
+                  std::exception_ptr error);
+
+    /// Requests served by attaching to another request's generation.
+    uint64_t coalesced() const { return m_coalesced.load(std::memory_order_relaxed); }
+
+private:
+    struct Flight {
+        RequestKey key;   ///< Material guards against fingerprint collisions
+        std::shared_ptr<SharedGeneration> generation;
+    };
+
+    void forget(const RequestKey& key, const std::shared_ptr<SharedGeneration>& generation);
+
+    std::mutex m_mu;
+    std::unordered_map<RequestKey, Flight, RequestKeyHash> m_inflight;
+    std::atomic<uint64_t> m_coalesced{0};
+};
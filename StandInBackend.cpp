@@ -0,0 +1,179 @@
+// ---------------------------------------------------------------------
+// StandInBackend.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "StandInBackend.hpp"
+#include "Hash.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// ---------------------------------------------------------------------
+// Helper types (file-private)
+// ---------------------------------------------------------------------
+namespace {
+    constexpr size_t c_bytes_per_token = 4; // rough BPE average for English
+
+    const char* const c_vocabulary[] = {
+        " the", " little", " fox", " ran", " over", " a", " green", " hill",
+        " and", " found", " shiny", " stone", " under", " old", " tree",
+        " it", " was", " very", " happy", " to", " see", " its", " friend",
+        " bird", " who", " sang", " song", " about", " sunny", " day",
+        " in", " forest"
+    };
+    constexpr uint64_t c_vocabulary_size =
+        sizeof(c_vocabulary) / sizeof(c_vocabulary[0]);
+
+    /// Build the token sequence of the reply: {"output": "w1 w2 ..."}
+    /// followed by `trailing_tokens` of chatter after the JSON object.
+    std::vector<const char*> make_reply(uint64_t context_hash, size_t reply_tokens,
+                                        size_t trailing_tokens) {
+        std::vector<const char*> tokens = { "{\"", "output", "\":", " \"" };
+        const size_t words = reply_tokens > tokens.size() + 1
+                                 ? reply_tokens - tokens.size() - 1
+                                 : 1;
+        uint64_t state = context_hash | 1;
+        for (size_t i = 0; i < words; ++i) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            const char* word = c_vocabulary[state % c_vocabulary_size];
+            tokens.push_back(i == 0 ? word + 1 : word); // no space after the quote
+        }
+        tokens.push_back("\"}");
+        for (size_t i = 0; i < trailing_tokens; ++i) {
+            tokens.push_back(i == 0 ? "\n" : c_vocabulary[i % c_vocabulary_size]);
+        }
+        return tokens;
+    }
+
+    struct StandInState : DialogState {
+        size_t context_tokens = 0;
+        uint64_t context_hash = c_fnv1a_offset;
+        size_t bytes = 0;
+
+        size_t size_bytes() const override { return bytes; }
+    };
+
+    // -----------------------------------------------------------------
+    // StandInDialog: sleeps for prefill/decode, checks abort in between
+    // -----------------------------------------------------------------
+    class StandInDialog : public InferenceDialog {
+    public:
+        explicit StandInDialog(const StandInConfig& config) : m_config(config) {}
+
+        bool query(const std::string& prompt, const TokenCallback& callback) override {
+            // An abort() that lands before the query starts cancels it; the
+            // flag is consumed only once the query is over.
+            struct ClearAbort {
+                std::atomic<bool>& flag;
+                ~ClearAbort() { flag.store(false, std::memory_order_relaxed); }
+            } clear_abort{m_abort};
+
+            if (!prefill_tokens(prompt)) {
+                if (callback) callback("", SentenceCode::Abort);
+                return true;
+            }
+
+            const auto reply = make_reply(m_context_hash, m_config.reply_tokens,
+                                          m_config.trailing_tokens);
+            for (size_t i = 0; i < reply.size(); ++i) {
+                if (!sleep_for_tokens(1, m_config.decode_tok_per_s)) {
+                    if (callback) callback("", SentenceCode::Abort);
+                    return true;
+                }
+                ++m_context_tokens;
+                if (callback) {
+                    callback(reply[i], i == 0 ? SentenceCode::Begin : SentenceCode::Continue);
+                }
+            }
+            if (callback) callback("", SentenceCode::End);
+            return true;
+        }
+
+        bool prefill(const std::string& prompt) override {
+            // Leaves m_abort set if aborted, so the query that follows stops too
+            return prefill_tokens(prompt);
+        }
+
+        std::shared_ptr<const DialogState> save_state() override {
+            auto state = std::make_shared<StandInState>();
+            state->context_tokens = m_context_tokens;
+            state->context_hash = m_context_hash;
+            state->bytes = m_context_tokens * m_config.kv_bytes_per_token;
+            return state;
+        }
+
+        bool restore_state(const DialogState& state) override {
+            const auto* s = dynamic_cast<const StandInState*>(&state);
+            if (!s) return false;
+            m_context_tokens = s->context_tokens;
+            m_context_hash = s->context_hash;
+            return true;
+        }
+
+        bool set_sampling(const GenerationParams&) override {
+            return true; // replies are deterministic regardless of sampling
+        }
+
+        bool reset() override {
+            m_context_tokens = 0;
+            m_context_hash = c_fnv1a_offset;
+            return true;
+        }
+
+        bool abort() override {
+            {
+                std::lock_guard<std::mutex> lk(m_mu);
+                m_abort.store(true, std::memory_order_relaxed);
+            }
+            m_cv.notify_all();
+            return true;
+        }
+
+    private:
+        /// Add `prompt` to the context at the prefill rate; false if aborted.
+        bool prefill_tokens(const std::string& prompt) {
+            const size_t prompt_tokens = prompt.size() / c_bytes_per_token + 1;
+            m_context_tokens += prompt_tokens;
+            m_context_hash = fnv1a64(prompt, m_context_hash);
+            return sleep_for_tokens(prompt_tokens, m_config.prefill_tok_per_s);
+        }
+
+        /// Returns false if aborted while "computing".
+        bool sleep_for_tokens(size_t tokens, double tok_per_s) {
+            if (m_abort.load(std::memory_order_relaxed)) return false;
+            if (tok_per_s <= 0.0) return true;
+
+            const auto duration = std::chrono::duration<double>(tokens / tok_per_s);
+            std::unique_lock<std::mutex> lk(m_mu);
+            return !m_cv.wait_for(lk, duration, [this] {
+                return m_abort.load(std::memory_order_relaxed);
+            });
+        }
+
+        StandInConfig m_config;
+        size_t m_context_tokens = 0;
+        uint64_t m_context_hash = c_fnv1a_offset; ///< Replies depend on the whole context
+        std::atomic<bool> m_abort{false};
+        std::mutex m_mu;
+        std::condition_variable m_cv;
+    };
+} // namespace
+
+// ---------------------------------------------------------------------
+// StandInBackend Implementation
+// ---------------------------------------------------------------------
+StandInBackend::StandInBackend(const StandInConfig& config)
+    : m_config(config)
+{
+}
+
+std::unique_ptr<InferenceDialog> StandInBackend::create_dialog() {
+    return std::make_unique<StandInDialog>(m_config);
+}
@@ -0,0 +1,37 @@
+// ---------------------------------------------------------------------
+// StandInBackend.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include "InferenceBackend.hpp"
+
+// ---------------------------------------------------------------------
+// StandInConfig: timing model of the CPU stand-in engine
+// ---------------------------------------------------------------------
+struct StandInConfig {
+    double prefill_tok_per_s = 300.0; ///< Prompt processing rate (result.md: ~300 tok/s)
+    double decode_tok_per_s  = 12.0;  ///< Token generation rate (result.md: ~12 tok/s)
+    size_t reply_tokens      = 24;    ///< Tokens per generated reply
+    size_t trailing_tokens   = 0;     ///< Tokens emitted after the closing brace
+    size_t kv_bytes_per_token = 114688; ///< Snapshot size model (Llama 3.2 3B, fp16 KV)
+};
+
+// ---------------------------------------------------------------------
+// StandInBackend: deterministic CPU engine with no SDK dependency
+// ---------------------------------------------------------------------
+/// Emits a fixed JSON reply derived from a hash of the context, sleeping
+/// to reproduce the configured prefill and decode rates. Lets the server
+/// be built, benchmarked and load-tested on machines without an NPU.
+class StandInBackend : public InferenceBackend {
+public:
+    explicit StandInBackend(const StandInConfig& config = {});
+
+    std::unique_ptr<InferenceDialog> create_dialog() override;
+    const char* name() const override { return "standin"; }
+
+private:
+    StandInConfig m_config;
+};
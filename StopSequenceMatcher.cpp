@@ -0,0 +1,60 @@
+// ---------------------------------------------------------------------
+// StopSequenceMatcher.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "StopSequenceMatcher.hpp"
+#include <algorithm>
+
+// ---------------------------------------------------------------------
+// StopSequenceMatcher Implementation
+// ---------------------------------------------------------------------
+StopSequenceMatcher::StopSequenceMatcher(std::vector<std::string> stop_sequences)
+    : m_stop_sequences(std::move(stop_sequences))
+{
+    m_stop_sequences.erase(
+        std::remove(m_stop_sequences.begin(), m_stop_sequences.end(), std::string()),
+        m_stop_sequences.end());
+}
+
+std::string StopSequenceMatcher::feed(const char* chunk) {
+    if (m_stopped) return {};
+    if (m_stop_sequences.empty()) return chunk;
+
+    m_pending += chunk;
+
+    // Earliest complete match wins.
+    size_t match = std::string::npos;
+    for (const auto& stop : m_stop_sequences) {
+        match = std::min(match, m_pending.find(stop));
+    }
+    if (match != std::string::npos) {
+        m_stopped = true;
+        std::string out = m_pending.substr(0, match);
+        m_pending.clear();
+        return out;
+    }
+
+    // Hold back the longest suffix that is a proper prefix of a stop sequence.
+    size_t keep = 0;
+    for (const auto& stop : m_stop_sequences) {
+        const size_t max_len = std::min(stop.size() - 1, m_pending.size());
+        for (size_t len = max_len; len > keep; --len) {
+            if (m_pending.compare(m_pending.size() - len, len, stop, 0, len) == 0) {
+                keep = len;
+                break;
+            }
+        }
+    }
+
+    std::string out = m_pending.substr(0, m_pending.size() - keep);
+    m_pending.erase(0, m_pending.size() - keep);
+    return out;
+}
+
+std::string StopSequenceMatcher::flush() {
+    std::string out;
+    out.swap(m_pending);
+    return out;
+}
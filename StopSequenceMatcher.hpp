@@ -0,0 +1,36 @@
+// ---------------------------------------------------------------------
+// StopSequenceMatcher.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------
+// StopSequenceMatcher: finds stop strings across token chunk boundaries
+// ---------------------------------------------------------------------
+/// Text is fed chunk by chunk. Anything that might still turn into a stop
+/// sequence is held back; everything else is released for output. Once a
+/// stop sequence is complete, the text before it is released and the
+/// matcher reports stopped(); the stop sequence itself is never emitted.
+class StopSequenceMatcher {
+public:
+    explicit StopSequenceMatcher(std::vector<std::string> stop_sequences);
+
+    /// Consume `chunk`; returns the text that is now safe to emit.
+    std::string feed(const char* chunk);
+
+    /// Release whatever is still held back (call at end of generation).
+    std::string flush();
+
+    bool stopped() const { return m_stopped; }
+    bool empty() const { return m_stop_sequences.empty(); }
+
+private:
+    std::vector<std::string> m_stop_sequences;
+    std::string m_pending; ///< Held-back tail that is a prefix of some stop sequence
+    bool m_stopped = false;
+};
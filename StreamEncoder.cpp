@@ -0,0 +1,259 @@
+// ---------------------------------------------------------------------
+// StreamEncoder.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "StreamEncoder.hpp"
+#include <json.hpp>
+
+using json = nlohmann::json;
+
+// ---------------------------------------------------------------------
+// FrameBuffer Implementation
+// ---------------------------------------------------------------------
+FrameBuffer::FrameBuffer(const StreamFlushPolicy& policy)
+    : m_policy(policy)
+{
+    m_data.reserve(m_policy.max_bytes + 256);
+}
+
+bool FrameBuffer::due(SentenceCode code) const {
+    if (m_data.empty()) return false;
+    if (m_writes == 0) return true;
+    if (code == SentenceCode::End || code == SentenceCode::Abort || code == SentenceCode::Complete) {
+        return true;
+    }
+    if (m_data.size() >= m_policy.max_bytes) return true;
+    return Clock::now() - m_last_write >= m_policy.interval;
+}
+
+bool FrameBuffer::overdue() const {
+    return !m_data.empty() && Clock::now() - m_last_write >= m_policy.interval;
+}
+
+void FrameBuffer::clear() {
+    m_data.clear();
+    m_last_write = Clock::now();
+    ++m_writes;
+}
+
+// ---------------------------------------------------------------------
+// PlainTextEncoder Implementation
+// ---------------------------------------------------------------------
+void PlainTextEncoder::encode_chunk(std::string& out, const char* text, size_t len, SentenceCode code) {
+    out.append(text, len);
+    if (code == SentenceCode::End) {
+        out += '\n'; // separate responses
+    }
+}
+
+void PlainTextEncoder::encode_finish(std::string&, const GenerationResult&) {
+    // Metadata goes out as HTTP trailers.
+}
+
+void PlainTextEncoder::encode_error(std::string& out, const std::string& message) {
+    out += message;
+    out += '\n';
+}
+
+// ---------------------------------------------------------------------
+// EventStreamEncoder Implementation
+// ---------------------------------------------------------------------
+double EventStreamEncoder::elapsed_ms(Clock::time_point t) const {
+    return std::chrono::duration<double, std::milli>(t - m_start).count();
+}
+
+void EventStreamEncoder::append_event(std::string& out, const char* event, json data) const {
+    if (m_binary) {
+        data["event"] = event;
+        append_binary(out, data, *m_binary);
+        return;
+    }
+    out += "event: ";
+    out += event;
+    out += "\ndata: ";
+    out += data.dump(-1, ' ', false, json::error_handler_t::replace);
+    out += "\n\n";
+}
+
+void EventStreamEncoder::encode_chunk(std::string& out, const char* text, size_t len, SentenceCode code) {
+    const auto now = Clock::now();
+    if (len) {
+        if (m_tokens++ == 0) m_first_token = now;
+        m_last_token = now;
+    }
+    std::string piece = std::move(m_utf8_tail);
+    m_utf8_tail.clear();
+    piece.append(text, len);
+    if (code != SentenceCode::End && code != SentenceCode::Abort && code != SentenceCode::Complete) {
+        // Dumped alone, each half of a split character becomes U+FFFD
+        const size_t complete = utf8_complete_length(piece);
+        m_utf8_tail.assign(piece, complete, std::string::npos);
+        piece.resize(complete);
+    }
+    append_event(out, "token", {
+        {"code", static_cast<int>(code)},
+        {"index", m_tokens},
+        {"text", std::move(piece)},
+        {"t_ms", elapsed_ms(now)},
+    });
+}
+
+void EventStreamEncoder::flush_utf8_tail(std::string& out) {
+    if (m_utf8_tail.empty()) return;
+    append_event(out, "token", {
+        {"code", static_cast<int>(SentenceCode::End)},
+        {"index", m_tokens},
+        {"text", std::move(m_utf8_tail)},
+        {"t_ms", elapsed_ms(Clock::now())},
+    });
+    m_utf8_tail.clear();
+}
+
+void EventStreamEncoder::encode_finish(std::string& out, const GenerationResult& result) {
+    flush_utf8_tail(out);
+    json kpis = {
+        {"finish_reason", to_string(result.finish_reason)},
+        {"generated_tokens", result.generated_tokens},
+        {"tokens_saved", result.tokens_saved},
+        {"prompt_tokens", result.prompt_tokens},
+        {"prefill_us", result.prefill_us},
+        {"decode_us", result.decode_us},
+        {"total_ms", elapsed_ms(Clock::now())},
+    };
+    if (m_tokens > 0) {
+        kpis["ttft_ms"] = elapsed_ms(m_first_token);
+    }
+    if (m_tokens > 1) {
+        const double decode_s = std::chrono::duration<double>(m_last_token - m_first_token).count();
+        if (decode_s > 0.0) {
+            kpis["decode_tok_per_s"] = static_cast<double>(m_tokens - 1) / decode_s;
+        }
+    }
+    append_event(out, "done", kpis);
+}
+
+void EventStreamEncoder::encode_error(std::string& out, const std::string& message) {
+    flush_utf8_tail(out);
+    append_event(out, "error", {{"message", message}});
+}
+
+// ---------------------------------------------------------------------
+// FieldExtractEncoder Implementation
+// ---------------------------------------------------------------------
+void append_json_escaped(std::string& out, std::string_view text) {
+    static const char c_hex[] = "0123456789abcdef";
+    for (const char c : text) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out += "\\u00";
+                    out += c_hex[(c >> 4) & 0xF];
+                    out += c_hex[c & 0xF];
+                } else {
+                    out += c;
+                }
+                break;
+        }
+    }
+}
+
+size_t utf8_complete_length(std::string_view text) {
+    // Step back over up to three continuation bytes to the last lead byte
+    size_t lead = text.size();
+    while (lead > 0 && text.size() - lead < 3 && (static_cast<unsigned char>(text[lead - 1]) & 0xC0) == 0x80) {
+        --lead;
+    }
+    if (lead == 0) return text.size();
+    const unsigned char c = static_cast<unsigned char>(text[lead - 1]);
+    const size_t needed = c >= 0xF8 ? 1 : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    return text.size() - (lead - 1) < needed ? lead - 1 : text.size();
+}
+
+void FieldExtractEncoder::encode_chunk(std::string& out, const char* text, size_t len, SentenceCode) {
+    m_out = &out;
+    m_extractor.feed(std::string_view(text, len), *this);
+    close_line();
+    m_out = nullptr;
+}
+
+void FieldExtractEncoder::encode_finish(std::string& out, const GenerationResult&) {
+    // Metadata goes out as HTTP trailers, as on the plain stream.
+    m_out = &out;
+    flush_utf8_tail();
+    close_line();
+    m_out = nullptr;
+}
+
+void FieldExtractEncoder::encode_error(std::string& out, const std::string& message) {
+    m_out = &out;
+    flush_utf8_tail();
+    close_line();
+    m_out = nullptr;
+    out += "{\"error\":\"";
+    append_json_escaped(out, message);
+    out += "\"}\n";
+}
+
+void FieldExtractEncoder::on_field_text(size_t key, std::string_view text) {
+    std::string joined;
+    if (!m_utf8_tail.empty()) {
+        if (m_tail_key == key) {
+            joined = std::move(m_utf8_tail);
+            joined.append(text);
+            text = joined;
+            m_utf8_tail.clear();
+        } else {
+            flush_utf8_tail();
+        }
+    }
+    // Escaped alone, each half of a split character is invalid UTF-8
+    const size_t complete = utf8_complete_length(text);
+    if (complete < text.size()) {
+        m_utf8_tail.assign(text.substr(complete));
+        m_tail_key = key;
+        text = text.substr(0, complete);
+    }
+    if (text.empty()) return;
+    open_line(key);
+    append_json_escaped(*m_out, text);
+}
+
+void FieldExtractEncoder::on_field_end(size_t key) {
+    flush_utf8_tail();
+    close_line();
+    *m_out += "{\"key\":\"";
+    append_json_escaped(*m_out, m_extractor.keys()[key]);
+    *m_out += "\",\"end\":true}\n";
+}
+
+void FieldExtractEncoder::open_line(size_t key) {
+    if (m_open_key == key) return;
+    close_line();
+    *m_out += "{\"key\":\"";
+    append_json_escaped(*m_out, m_extractor.keys()[key]);
+    *m_out += "\",\"text\":\"";
+    m_open_key = key;
+}
+
+/// A value that ended (or a stream that stopped) mid-character: send
+/// U+FFFD in its place so the line stays valid UTF-8.
+void FieldExtractEncoder::flush_utf8_tail() {
+    if (m_utf8_tail.empty()) return;
+    open_line(m_tail_key);
+    *m_out += "\xEF\xBF\xBD";
+    m_utf8_tail.clear();
+}
+
+void FieldExtractEncoder::close_line() {
+    if (m_open_key != JsonFieldExtractor::npos) {
+        *m_out += "\"}\n";
+        m_open_key = JsonFieldExtractor::npos;
+    }
+}
@@ -0,0 +1,169 @@
+// ---------------------------------------------------------------------
+// StreamEncoder.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include "ChatManager.hpp"
+#include "JsonStream.hpp"
+#include "WireFormat.hpp"
+
+// ---------------------------------------------------------------------
+// StreamEncoder: wire framing of a streamed generation
+// ---------------------------------------------------------------------
+/// Turns ChatManager callbacks into response bytes. Encoders append to a
+/// caller-owned buffer so the writer decides when bytes hit the socket.
+class StreamEncoder {
+public:
+    virtual ~StreamEncoder() = default;
+
+    virtual const char* content_type() const = 0;
+
+    /// One callback from ChatManager; `len` is strlen(text).
+    virtual void encode_chunk(std::string& out, const char* text, size_t len, SentenceCode code) = 0;
+
+    /// Closing frame once the generation has finished.
+    virtual void encode_finish(std::string& out, const GenerationResult& result) = 0;
+
+    /// In-band error after the response has already started; `message`
+    /// is the human-readable line ("Error: ...").
+    virtual void encode_error(std::string& out, const std::string& message) = 0;
+};
+
+// ---------------------------------------------------------------------
+// StreamFlushPolicy / FrameBuffer: when encoded bytes hit the socket
+// ---------------------------------------------------------------------
+struct StreamFlushPolicy {
+    std::chrono::milliseconds interval{50}; ///< Longest time since the last write; 0 = every callback
+    size_t max_bytes = 4096;                ///< Write once this much is buffered
+};
+
+/// Per-response buffer that coalesces frames into few large writes. The
+/// first token goes out at once (time to first token), then the buffer
+/// is written when `interval` has passed since the last write, when it
+/// holds `max_bytes`, or when the response ends. due() is checked on each
+/// token; a writer that wakes between tokens checks overdue() so a
+/// stalled decode does not hold buffered output past `interval`.
+class FrameBuffer {
+public:
+    explicit FrameBuffer(const StreamFlushPolicy& policy);
+
+    /// Encoders append here.
+    std::string& data() { return m_data; }
+
+    /// Call after encoding one callback: true if data() should be written now.
+    bool due(SentenceCode code) const;
+
+    /// Without a new token: true if buffered data has waited `interval`.
+    bool overdue() const;
+
+    /// The contents were written (or dropped).
+    void clear();
+
+    size_t writes() const { return m_writes; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    StreamFlushPolicy m_policy;
+    std::string m_data;
+    Clock::time_point m_last_write;
+    size_t m_writes = 0;
+};
+
+// ---------------------------------------------------------------------
+// PlainTextEncoder: raw model text, "\n" after each response (/chat_stream)
+// ---------------------------------------------------------------------
+class PlainTextEncoder : public StreamEncoder {
+public:
+    const char* content_type() const override { return "text/plain"; }
+    void encode_chunk(std::string& out, const char* text, size_t len, SentenceCode code) override;
+    void encode_finish(std::string& out, const GenerationResult& result) override;
+    void encode_error(std::string& out, const std::string& message) override;
+};
+
+// ---------------------------------------------------------------------
+// EventStreamEncoder: Server-Sent Events (/chat_events)
+// ---------------------------------------------------------------------
+/// Each callback becomes
+///     event: token
+///     data: {"code":2,"index":5,"text":"...","t_ms":812.4}
+/// where `index` counts tokens delivered so far (including this one) and
+/// `t_ms` is measured from request arrival. The stream closes with an
+/// `event: done` carrying the finish reason and latency KPIs, or an
+/// `event: error`. Given a binary format, each event is instead one
+/// msgpack/CBOR map holding the same fields plus "event" (/chat_stream
+/// with a binary Accept). A UTF-8 character split across callbacks is
+/// held back and sent whole with the next token.
+class EventStreamEncoder : public StreamEncoder {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit EventStreamEncoder(Clock::time_point start, std::optional<BinaryFormat> binary = std::nullopt)
+        : m_start(start), m_binary(binary) {}
+
+    const char* content_type() const override {
+        return m_binary ? ::content_type(*m_binary) : "text/event-stream";
+    }
+    void encode_chunk(std::string& out, const char* text, size_t len, SentenceCode code) override;
+    void encode_finish(std::string& out, const GenerationResult& result) override;
+    void encode_error(std::string& out, const std::string& message) override;
+
+private:
+    double elapsed_ms(Clock::time_point t) const;
+    void append_event(std::string& out, const char* event, nlohmann::json data) const;
+    void flush_utf8_tail(std::string& out);
+
+    Clock::time_point m_start;
+    std::optional<BinaryFormat> m_binary;
+    std::string m_utf8_tail; ///< Incomplete UTF-8 sequence that ended the last token
+    Clock::time_point m_first_token;
+    Clock::time_point m_last_token;
+    size_t m_tokens = 0;
+};
+
+// ---------------------------------------------------------------------
+// FieldExtractEncoder: decoded values of selected JSON keys (/chat_stream "extract")
+// ---------------------------------------------------------------------
+/// Runs a JsonFieldExtractor over the model output and emits NDJSON:
+///     {"key":"output","text":"Hel"}
+///     {"key":"output","text":"lo"}
+///     {"key":"output","end":true}
+/// Text from one callback for one key is merged into a single line, and
+/// a UTF-8 character split across callbacks is held back until it is
+/// whole. Everything outside the selected string values is dropped.
+class FieldExtractEncoder : public StreamEncoder, private JsonFieldExtractor::Listener {
+public:
+    explicit FieldExtractEncoder(std::vector<std::string> keys) : m_extractor(std::move(keys)) {}
+
+    const char* content_type() const override { return "application/x-ndjson"; }
+    void encode_chunk(std::string& out, const char* text, size_t len, SentenceCode code) override;
+    void encode_finish(std::string& out, const GenerationResult& result) override;
+    void encode_error(std::string& out, const std::string& message) override;
+
+private:
+    void on_field_text(size_t key, std::string_view text) override;
+    void on_field_end(size_t key) override;
+    void open_line(size_t key);
+    void close_line();
+    void flush_utf8_tail();
+
+    JsonFieldExtractor m_extractor;
+    std::string* m_out = nullptr;               ///< Buffer of the current encode_chunk
+    size_t m_open_key = JsonFieldExtractor::npos; ///< Key of the unterminated text line
+    std::string m_utf8_tail;                    ///< Incomplete UTF-8 sequence ending the last fragment
+    size_t m_tail_key = JsonFieldExtractor::npos; ///< Key whose value m_utf8_tail belongs to
+};
+
+/// Append `text` as the body of a JSON string literal (no quotes).
+void append_json_escaped(std::string& out, std::string_view text);
+
+/// Length of `text` without the incomplete UTF-8 sequence, if any, that
+/// it ends with (a character the next chunk will finish).
+size_t utf8_complete_length(std::string_view text);
@@ -0,0 +1,177 @@
+// ---------------------------------------------------------------------
+// TokenRing.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "TokenRing.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    size_t round_up_pow2(size_t n) {
+        size_t p = 64;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    void append_record(std::string& out, const char* text, uint32_t len, SentenceCode code) {
+        out.append(reinterpret_cast<const char*>(&len), sizeof(len));
+        out += static_cast<char>(code);
+        out.append(text, len);
+    }
+} // namespace
+
+// ---------------------------------------------------------------------
+// TokenRing Implementation
+// ---------------------------------------------------------------------
+TokenRing::TokenRing(const TokenRingConfig& config)
+    : m_capacity(round_up_pow2(config.capacity_bytes)),
+      m_mask(m_capacity - 1),
+      m_overflow(config.overflow),
+      m_data(new char[m_capacity])
+{
+}
+
+void TokenRing::copy_in(uint64_t pos, const void* src, size_t n) {
+    const size_t at = static_cast<size_t>(pos) & m_mask;
+    const size_t first = std::min(n, m_capacity - at);
+    std::memcpy(m_data.get() + at, src, first);
+    std::memcpy(m_data.get(), static_cast<const char*>(src) + first, n - first);
+}
+
+void TokenRing::copy_out(uint64_t pos, void* dst, size_t n) const {
+    const size_t at = static_cast<size_t>(pos) & m_mask;
+    const size_t first = std::min(n, m_capacity - at);
+    std::memcpy(dst, m_data.get() + at, first);
+    std::memcpy(static_cast<char*>(dst) + first, m_data.get(), n - first);
+}
+
+bool TokenRing::try_push_ring(const char* text, uint32_t len, SentenceCode code) {
+    const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    const uint64_t head = m_head.load(std::memory_order_acquire);
+    const size_t need = c_header_bytes + len;
+    if (need > m_capacity - static_cast<size_t>(tail - head)) {
+        return false;
+    }
+
+    const char code_byte = static_cast<char>(code);
+    copy_in(tail, &len, sizeof(len));
+    copy_in(tail + sizeof(len), &code_byte, 1);
+    copy_in(tail + c_header_bytes, text, len);
+    m_tail.store(tail + need, std::memory_order_release);
+    return true;
+}
+
+bool TokenRing::push(const char* text, SentenceCode code) {
+    if (m_overflowed.load(std::memory_order_relaxed)) {
+        return false; // never leave a gap in the consumer's stream
+    }
+    const uint32_t len = static_cast<uint32_t>(std::strlen(text));
+
+    if (!m_spilling.load(std::memory_order_acquire)) {
+        if (try_push_ring(text, len, code)) {
+            notify();
+            return true;
+        }
+        if (m_overflow == RingOverflowPolicy::Cancel) {
+            m_overflowed.store(true, std::memory_order_release);
+            notify();
+            return false;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(m_spill_mu);
+        // The consumer may have emptied both buffers since we looked; once it
+        // clears m_spilling (under this lock) the ring is empty, so order holds.
+        if (m_spilling.load(std::memory_order_relaxed) || !try_push_ring(text, len, code)) {
+            m_spilling.store(true, std::memory_order_release);
+            append_record(m_spill, text, len, code);
+        }
+    }
+    notify();
+    return true;
+}
+
+void TokenRing::notify() {
+    // Pairs with the fence in wait(): either we see the consumer waiting,
+    // or it sees our record before it sleeps.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_consumer_waiting.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lk(m_wait_mu);
+        m_wait_cv.notify_one();
+    }
+}
+
+void TokenRing::deliver(SentenceCode code, const InferenceDialog::TokenCallback& callback) {
+    if (code == SentenceCode::End || code == SentenceCode::Abort) {
+        m_ended = true;
+    }
+    callback(m_scratch.c_str(), code);
+}
+
+size_t TokenRing::drain_ring(const InferenceDialog::TokenCallback& callback) {
+    size_t delivered = 0;
+
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    const uint64_t tail = m_tail.load(std::memory_order_acquire);
+    while (head != tail) {
+        uint32_t len = 0;
+        char code_byte = 0;
+        copy_out(head, &len, sizeof(len));
+        copy_out(head + sizeof(len), &code_byte, 1);
+        m_scratch.resize(len);
+        copy_out(head + c_header_bytes, m_scratch.data(), len);
+        head += c_header_bytes + len;
+        m_head.store(head, std::memory_order_release);
+
+        deliver(static_cast<SentenceCode>(code_byte), callback);
+        ++delivered;
+    }
+    return delivered;
+}
+
+size_t TokenRing::drain(const InferenceDialog::TokenCallback& callback) {
+    size_t delivered = drain_ring(callback);
+
+    if (m_spilling.load(std::memory_order_acquire)) {
+        // While the callbacks above ran, the producer may have refilled the
+        // space they freed before it started spilling. Those records precede
+        // the spill, and the ring is frozen while m_spilling is set, so one
+        // more pass empties it for good.
+        delivered += drain_ring(callback);
+        {
+            std::lock_guard<std::mutex> lk(m_spill_mu);
+            m_spill_out.swap(m_spill);
+            m_spill.clear();
+            m_spilling.store(false, std::memory_order_release);
+        }
+        size_t pos = 0;
+        while (pos < m_spill_out.size()) {
+            uint32_t len = 0;
+            std::memcpy(&len, m_spill_out.data() + pos, sizeof(len));
+            const auto code = static_cast<SentenceCode>(m_spill_out[pos + sizeof(len)]);
+            m_scratch.assign(m_spill_out, pos + c_header_bytes, len);
+            deliver(code, callback);
+            pos += c_header_bytes + len;
+            ++delivered;
+        }
+        m_spill_out.clear();
+    }
+    return delivered;
+}
+
+void TokenRing::wait(std::chrono::milliseconds timeout) {
+    m_consumer_waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    {
+        std::unique_lock<std::mutex> lk(m_wait_mu);
+        m_wait_cv.wait_for(lk, timeout, [this] {
+            return m_tail.load(std::memory_order_acquire) != m_head.load(std::memory_order_relaxed) ||
+                   m_spilling.load(std::memory_order_acquire) ||
+                   m_overflowed.load(std::memory_order_acquire);
+        });
+    }
+    m_consumer_waiting.store(false, std::memory_order_relaxed);
+}
@@ -0,0 +1,92 @@
+// ---------------------------------------------------------------------
+// TokenRing.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "InferenceBackend.hpp"
+
+/// What the producer does when the consumer has fallen a full ring behind.
+enum class RingOverflowPolicy {
+    Spill,  ///< Continue into a heap buffer until the consumer catches up
+    Cancel  ///< Give up on the consumer; push() returns false from then on
+};
+
+struct TokenRingConfig {
+    size_t capacity_bytes = 16 * 1024;  ///< Ring size (rounded up to a power of two)
+    RingOverflowPolicy overflow = RingOverflowPolicy::Spill;
+};
+
+// ---------------------------------------------------------------------
+// TokenRing: single-producer/single-consumer buffer of token callbacks
+// ---------------------------------------------------------------------
+/// The inference thread push()es each (text, SentenceCode) as it is
+/// generated; the HTTP thread drain()s them and writes to the socket, so
+/// a slow client never holds up the dialog. The ring itself is lock-free
+/// (records are [u32 length][u8 code][bytes] in a byte array indexed by
+/// two monotonically increasing atomics). The spill buffer and the
+/// consumer's sleep take a mutex, but only on the overflow and idle paths.
+class TokenRing {
+public:
+    explicit TokenRing(const TokenRingConfig& config = {});
+
+    /// Producer. Returns false if the record was dropped because the ring
+    /// overflowed under RingOverflowPolicy::Cancel.
+    bool push(const char* text, SentenceCode code);
+
+    /// Consumer: hand every buffered record to `callback` in order.
+    /// Returns the number delivered.
+    size_t drain(const InferenceDialog::TokenCallback& callback);
+
+    /// Consumer: sleep until a record is pushed or `timeout` passes.
+    void wait(std::chrono::milliseconds timeout);
+
+    /// Consumer: an End or Abort record has been drained.
+    bool ended() const { return m_ended; }
+
+    /// A push() was dropped under RingOverflowPolicy::Cancel.
+    bool overflowed() const { return m_overflowed.load(std::memory_order_acquire); }
+
+private:
+    static constexpr size_t c_header_bytes = sizeof(uint32_t) + 1;
+
+    bool try_push_ring(const char* text, uint32_t len, SentenceCode code);
+    void copy_in(uint64_t pos, const void* src, size_t n);
+    void copy_out(uint64_t pos, void* dst, size_t n) const;
+    /// Consumer: deliver the ring's records up to the current tail.
+    size_t drain_ring(const InferenceDialog::TokenCallback& callback);
+    /// Hand m_scratch to `callback`.
+    void deliver(SentenceCode code, const InferenceDialog::TokenCallback& callback);
+    void notify();
+
+    const size_t m_capacity;
+    const size_t m_mask;
+    const RingOverflowPolicy m_overflow;
+    std::unique_ptr<char[]> m_data;
+
+    alignas(64) std::atomic<uint64_t> m_head{0}; ///< Consumer position
+    alignas(64) std::atomic<uint64_t> m_tail{0}; ///< Producer position
+
+    std::atomic<bool> m_spilling{false};   ///< Producer writes to m_spill, not the ring
+    std::mutex m_spill_mu;
+    std::string m_spill;                   ///< Records in ring format, guarded by m_spill_mu
+
+    std::atomic<bool> m_consumer_waiting{false};
+    std::mutex m_wait_mu;
+    std::condition_variable m_wait_cv;
+
+    std::atomic<bool> m_overflowed{false};
+    bool m_ended = false;                  ///< Consumer-only
+    std::string m_scratch;                 ///< Consumer-only: NUL-terminated copy of a record
+    std::string m_spill_out;               ///< Consumer-only: spill taken over for delivery
+};
@@ -0,0 +1,181 @@
+// ---------------------------------------------------------------------
+// Trace.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "Trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+    struct SpanRecord {
+        const char* name;
+        uint64_t request_id;
+        int64_t start_us; ///< Since the tracer's epoch
+        int64_t duration_us;
+    };
+
+    /// splitmix64 finalizer: consecutive ids land uniformly in [0, 2^64).
+    uint64_t Mix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    thread_local uint64_t t_current_request = 0;
+} // namespace
+
+// ---------------------------------------------------------------------
+// ThreadBuffer: fixed ring of one thread's spans
+// ---------------------------------------------------------------------
+/// Written by its owning thread; read by chrome_json(). Full rings
+/// overwrite their oldest span.
+class Tracer::ThreadBuffer {
+public:
+    ThreadBuffer(size_t capacity, uint32_t thread)
+        : m_thread(thread), m_spans(std::max<size_t>(1, capacity)) {}
+
+    /// True if an older span was overwritten.
+    bool push(const SpanRecord& span) {
+        std::lock_guard<std::mutex> lk(m_mu);
+        m_spans[m_written % m_spans.size()] = span;
+        return ++m_written > m_spans.size();
+    }
+
+    /// Append the buffered spans, oldest first.
+    void copy(std::vector<SpanRecord>& out, bool clear) {
+        std::lock_guard<std::mutex> lk(m_mu);
+        const size_t count = std::min(m_written, m_spans.size());
+        for (size_t i = m_written - count; i < m_written; ++i) {
+            out.push_back(m_spans[i % m_spans.size()]);
+        }
+        if (clear) m_written = 0;
+    }
+
+    uint32_t thread() const { return m_thread; }
+
+    std::atomic<bool> orphaned{false}; ///< Owning thread has exited
+
+private:
+    const uint32_t m_thread;
+    std::mutex m_mu;
+    std::vector<SpanRecord> m_spans;
+    size_t m_written = 0; ///< Spans ever pushed since the last clear
+};
+
+namespace {
+    /// Marks the thread's buffer orphaned when the thread exits, so a
+    /// clearing dump can drop it.
+    struct LocalBuffer {
+        std::shared_ptr<void> buffer;
+        std::atomic<bool>* orphaned = nullptr;
+        ~LocalBuffer() {
+            if (orphaned) orphaned->store(true, std::memory_order_release);
+        }
+    };
+    thread_local LocalBuffer t_local;
+} // namespace
+
+// ---------------------------------------------------------------------
+// Tracer Implementation
+// ---------------------------------------------------------------------
+Tracer& Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::configure(const TracerConfig& config) {
+    std::lock_guard<std::mutex> lk(m_mu);
+    m_config = config;
+    const double rate = std::clamp(config.sample_rate, 0.0, 1.0);
+    m_sample_all.store(rate >= 1.0, std::memory_order_relaxed);
+    m_sample_threshold.store(rate >= 1.0 ? 0 : static_cast<uint64_t>(std::ldexp(rate, 64)),
+                             std::memory_order_relaxed);
+}
+
+bool Tracer::sampled(uint64_t request_id) const {
+    if (request_id == 0) return false;
+    if (m_sample_all.load(std::memory_order_relaxed)) return true;
+    return Mix(request_id) < m_sample_threshold.load(std::memory_order_relaxed);
+}
+
+uint64_t Tracer::current_request() {
+    return t_current_request;
+}
+
+void Tracer::record(const char* name, uint64_t request_id, Clock::time_point start, Clock::time_point end) {
+    const SpanRecord span{
+        name, request_id,
+        std::chrono::duration_cast<std::chrono::microseconds>(start - m_epoch).count(),
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()};
+    if (local_buffer().push(span)) {
+        m_overwritten.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+Tracer::ThreadBuffer& Tracer::local_buffer() {
+    if (!t_local.buffer) {
+        std::lock_guard<std::mutex> lk(m_mu);
+        auto buffer = std::make_shared<ThreadBuffer>(m_config.thread_buffer_spans,
+                                                     static_cast<uint32_t>(m_buffers.size() + 1));
+        m_buffers.push_back(buffer);
+        t_local.orphaned = &buffer->orphaned;
+        t_local.buffer = std::move(buffer);
+    }
+    return *static_cast<ThreadBuffer*>(t_local.buffer.get());
+}
+
+std::string Tracer::chrome_json(bool clear) {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        buffers = m_buffers;
+        if (clear) {
+            m_buffers.erase(std::remove_if(m_buffers.begin(), m_buffers.end(),
+                                           [](const auto& buffer) {
+                                               return buffer->orphaned.load(std::memory_order_acquire);
+                                           }),
+                            m_buffers.end());
+        }
+    }
+
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    std::vector<SpanRecord> spans;
+    bool first = true;
+    char line[256];
+    for (const auto& buffer : buffers) {
+        spans.clear();
+        buffer->copy(spans, clear);
+        for (const SpanRecord& span : spans) {
+            // Span names are literals without characters that need escaping
+            const int n = std::snprintf(
+                line, sizeof(line),
+                "%s\n{\"name\":\"%s\",\"cat\":\"chatapp\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,"
+                "\"pid\":1,\"tid\":%u,\"args\":{\"request_id\":\"%llx\"}}",
+                first ? "" : ",", span.name, static_cast<long long>(span.start_us),
+                static_cast<long long>(span.duration_us), buffer->thread(),
+                static_cast<unsigned long long>(span.request_id));
+            out.append(line, static_cast<size_t>(std::min<int>(n, sizeof(line) - 1)));
+            first = false;
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+// ---------------------------------------------------------------------
+// TraceScope Implementation
+// ---------------------------------------------------------------------
+TraceScope::TraceScope(uint64_t request_id)
+    : m_previous(t_current_request)
+{
+    t_current_request = Tracer::instance().sampled(request_id) ? request_id : 0;
+}
+
+TraceScope::~TraceScope()
+{
+    t_current_request = m_previous;
+}
@@ -0,0 +1,122 @@
+// ---------------------------------------------------------------------
+// Trace.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------
+// TracerConfig
+// ---------------------------------------------------------------------
+struct TracerConfig {
+    double sample_rate = 0.0;           ///< Fraction of requests whose spans are kept; 0 disables
+    size_t thread_buffer_spans = 8192;  ///< Per-thread ring; the oldest spans are overwritten
+};
+
+// ---------------------------------------------------------------------
+// Tracer: per-request span recording, dumped as Chrome trace JSON
+// ---------------------------------------------------------------------
+/// Every request gets an id; whether its spans are kept is a pure
+/// function of the id, so the threads a request passes through agree
+/// without coordination. A span of a sampled request is one record
+/// appended to a fixed ring owned by the recording thread (its lock is
+/// only contended while a dump copies the ring). Spans of unsampled
+/// requests cost one thread-local load. The rings act as a flight
+/// recorder: chrome_json() returns the most recent spans of every
+/// thread as trace-event JSON that opens in Perfetto or chrome://tracing.
+class Tracer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static Tracer& instance();
+
+    /// Apply `config`. Call before serving requests.
+    void configure(const TracerConfig& config);
+
+    /// Id for a new request; never 0.
+    uint64_t next_request_id() { return m_next_id.fetch_add(1, std::memory_order_relaxed) + 1; }
+
+    bool sampled(uint64_t request_id) const;
+
+    /// Sampled request the calling thread is working on, or 0.
+    static uint64_t current_request();
+
+    /// Record a span of `request_id` on the calling thread. `name` must
+    /// outlive the tracer (a string literal).
+    void record(const char* name, uint64_t request_id, Clock::time_point start, Clock::time_point end);
+
+    /// Trace-event JSON of every buffered span; `clear` empties the rings.
+    std::string chrome_json(bool clear);
+
+    /// Spans overwritten before they were dumped.
+    uint64_t overwritten() const { return m_overwritten.load(std::memory_order_relaxed); }
+
+private:
+    class ThreadBuffer;
+
+    Tracer() = default;
+
+    ThreadBuffer& local_buffer();
+
+    std::atomic<uint64_t> m_next_id{0};
+    std::atomic<uint64_t> m_sample_threshold{0}; ///< Sampled if the mixed id is below this
+    std::atomic<bool> m_sample_all{false};
+    std::atomic<uint64_t> m_overwritten{0};
+    const Clock::time_point m_epoch = Clock::now();
+
+    std::mutex m_mu;                                    ///< Guards the fields below
+    TracerConfig m_config;
+    std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+};
+
+/// Makes `request_id` the calling thread's current request (0 if it is
+/// not sampled) until destroyed, then restores the previous one.
+class TraceScope {
+public:
+    explicit TraceScope(uint64_t request_id);
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+    ~TraceScope();
+
+private:
+    uint64_t m_previous;
+};
+
+/// Records the enclosing scope as a span of the current request.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name)
+        : m_name(name), m_request(Tracer::current_request()),
+          m_start(m_request ? Tracer::Clock::now() : Tracer::Clock::time_point{}) {}
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+    ~TraceSpan() { end(); }
+
+    /// End the span early; later calls do nothing.
+    void end() {
+        if (!m_request) return;
+        Tracer::instance().record(m_name, m_request, m_start, Tracer::Clock::now());
+        m_request = 0;
+    }
+
+private:
+    const char* m_name;
+    uint64_t m_request;
+    Tracer::Clock::time_point m_start;
+};
+
+#define CHATAPP_TRACE_CONCAT_(a, b) a##b
+#define CHATAPP_TRACE_CONCAT(a, b) CHATAPP_TRACE_CONCAT_(a, b)
+
+/// Record the rest of the enclosing block as span `name` (a literal).
+#define CHATAPP_TRACE_SPAN(name) \
+    TraceSpan CHATAPP_TRACE_CONCAT(chatapp_trace_span_, __LINE__)(name)
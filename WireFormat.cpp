@@ -0,0 +1,88 @@
+// ---------------------------------------------------------------------
+// WireFormat.cpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#include "WireFormat.hpp"
+#include <cctype>
+#include <cstdlib>
+
+using json = nlohmann::json;
+
+namespace {
+    std::string_view Trim(std::string_view s) {
+        const size_t begin = s.find_first_not_of(" \t");
+        if (begin == std::string_view::npos) return {};
+        const size_t end = s.find_last_not_of(" \t");
+        return s.substr(begin, end - begin + 1);
+    }
+
+    bool IEquals(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (std::tolower(static_cast<unsigned char>(a[i])) !=
+                std::tolower(static_cast<unsigned char>(b[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::optional<BinaryFormat> FromMediaType(std::string_view type) {
+        if (IEquals(type, "application/msgpack") || IEquals(type, "application/x-msgpack") ||
+            IEquals(type, "application/vnd.msgpack")) {
+            return BinaryFormat::MsgPack;
+        }
+        if (IEquals(type, "application/cbor")) return BinaryFormat::Cbor;
+        return std::nullopt;
+    }
+} // namespace
+
+const char* content_type(BinaryFormat format) {
+    return format == BinaryFormat::MsgPack ? "application/msgpack" : "application/cbor";
+}
+
+std::optional<BinaryFormat> binary_format_from_content_type(std::string_view content_type) {
+    return FromMediaType(Trim(content_type.substr(0, content_type.find(';'))));
+}
+
+std::optional<BinaryFormat> binary_format_from_accept(std::string_view accept) {
+    while (!accept.empty()) {
+        const size_t comma = accept.find(',');
+        const std::string_view range = accept.substr(0, comma);
+        accept = comma == std::string_view::npos ? std::string_view{} : accept.substr(comma + 1);
+
+        const size_t semicolon = range.find(';');
+        const auto format = FromMediaType(Trim(range.substr(0, semicolon)));
+        if (!format) continue;
+
+        // Honour an explicit refusal ("application/cbor;q=0")
+        bool refused = false;
+        for (std::string_view params = semicolon == std::string_view::npos ? std::string_view{}
+                                                                           : range.substr(semicolon + 1);
+             !params.empty();) {
+            const size_t next = params.find(';');
+            const std::string_view param = Trim(params.substr(0, next));
+            params = next == std::string_view::npos ? std::string_view{} : params.substr(next + 1);
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                refused = std::strtod(std::string(param.substr(2)).c_str(), nullptr) <= 0.0;
+            }
+        }
+        if (!refused) return format;
+    }
+    return std::nullopt;
+}
+
+json parse_body(const std::string& body, std::optional<BinaryFormat> format) {
+    if (!format) return json::parse(body);
+    return *format == BinaryFormat::MsgPack ? json::from_msgpack(body) : json::from_cbor(body);
+}
+
+void append_binary(std::string& out, const json& value, BinaryFormat format) {
+    if (format == BinaryFormat::MsgPack) {
+        json::to_msgpack(value, out);
+    } else {
+        json::to_cbor(value, out);
+    }
+}
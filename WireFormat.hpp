@@ -0,0 +1,37 @@
+// ---------------------------------------------------------------------
+// WireFormat.hpp
+// ---------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// ---------------------------------------------------------------------
+
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <json.hpp>
+
+// ---------------------------------------------------------------------
+// BinaryFormat: compact encodings negotiated instead of JSON/text
+// ---------------------------------------------------------------------
+/// Requests may be sent as application/msgpack or application/cbor
+/// (Content-Type) and responses requested in either (Accept). Both carry
+/// the same document as the JSON they replace; streamed responses are a
+/// sequence of self-delimiting values, one per frame.
+enum class BinaryFormat { MsgPack, Cbor };
+
+const char* content_type(BinaryFormat format);
+
+/// Format named by a Content-Type value; nullopt means JSON.
+std::optional<BinaryFormat> binary_format_from_content_type(std::string_view content_type);
+
+/// First binary format listed (and not refused with q=0) in an Accept
+/// value; nullopt keeps the endpoint's usual response type.
+std::optional<BinaryFormat> binary_format_from_accept(std::string_view accept);
+
+/// Decode a request body sent as `format` (JSON if nullopt). Throws
+/// nlohmann::json::exception on malformed input.
+nlohmann::json parse_body(const std::string& body, std::optional<BinaryFormat> format);
+
+/// Append `value` encoded as `format` to `out`.
+void append_binary(std::string& out, const nlohmann::json& value, BinaryFormat format);
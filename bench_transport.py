@@ -0,0 +1,99 @@
+"""
+Compare per-request overhead of loopback TCP and a UNIX domain socket.
+
+Start the server with both listeners, e.g.
+
+    ChatApp --backend standin --unix-socket /tmp/chatapp.sock
+
+then run
+
+    python bench_transport.py --socket /tmp/chatapp.sock
+
+Each transport is measured on a persistent (keep-alive) connection and
+with a new connection per request, for GET /hi (transport and HTTP only)
+and for a small classifier-style POST /chat (one output token).
+"""
+import argparse
+import http.client
+import json
+import socket
+import statistics
+import time
+
+
+class UnixHTTPConnection(http.client.HTTPConnection):
+    """http.client over an AF_UNIX stream socket."""
+
+    def __init__(self, path: str):
+        super().__init__("localhost")
+        self.path = path
+
+    def connect(self):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(self.path)
+
+
+CLASSIFIER_BODY = json.dumps({
+    "sys_prompt": "Classify the sentiment of the user's message as positive or negative.",
+    "user_prompt": "I loved the story about the fox.",
+    "max_new_tokens": 1,
+    "temperature": 0,
+})
+
+
+def measure(connect, method: str, path: str, body, count: int, reuse: bool):
+    """Latencies in microseconds of `count` sequential requests."""
+    latencies = []
+    conn = connect() if reuse else None
+    for _ in range(count):
+        start = time.perf_counter()
+        if not reuse:
+            conn = connect()
+        conn.request(method, path, body=body,
+                     headers={"Content-Type": "application/json"} if body else {})
+        response = conn.getresponse()
+        response.read()
+        if not reuse:
+            conn.close()
+        latencies.append((time.perf_counter() - start) * 1e6)
+        if response.status != 200:
+            raise RuntimeError(f"{method} {path}: HTTP {response.status}")
+    if reuse:
+        conn.close()
+    return latencies
+
+
+def summarize(latencies):
+    ordered = sorted(latencies)
+    return {
+        "mean_us": round(statistics.fmean(ordered), 1),
+        "p50_us": round(ordered[len(ordered) // 2], 1),
+        "p99_us": round(ordered[min(len(ordered) - 1, int(len(ordered) * 0.99))], 1),
+    }
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--socket", required=True, help="Path given to --unix-socket")
+    parser.add_argument("--requests", type=int, default=2000)
+    args = parser.parse_args()
+
+    transports = {
+        "tcp": lambda: http.client.HTTPConnection(args.host, args.port),
+        "uds": lambda: UnixHTTPConnection(args.socket),
+    }
+    cases = [
+        ("GET /hi", "GET", "/hi", None),
+        ("POST /chat (1 token)", "POST", "/chat", CLASSIFIER_BODY),
+    ]
+
+    print(f"{'request':<22} {'connection':<11} {'transport':<9} {'mean_us':>9} {'p50_us':>9} {'p99_us':>9}")
+    for label, method, path, body in cases:
+        for reuse in (True, False):
+            for name, connect in transports.items():
+                measure(connect, method, path, body, 50, reuse)  # warm up
+                stats = summarize(measure(connect, method, path, body, args.requests, reuse))
+                print(f"{label:<22} {'keep-alive' if reuse else 'new':<11} {name:<9} "
+                      f"{stats['mean_us']:>9} {stats['p50_us']:>9} {stats['p99_us']:>9}")